@@ -0,0 +1,195 @@
+/**
+ * @file mds_config_cache.h
+ * @brief Gateway-side cache of MDS device configuration
+ *
+ * mds_read_device_config() costs four feature-report control transfers per
+ * session start. The device configuration only changes with a firmware or
+ * project change, so the cache remembers it per device, keyed by USB serial
+ * number and device release number (bcdDevice). On reconnect the session
+ * can start streaming with the cached configuration after a single
+ * Set_Report, and check it against the device later with
+ * mds_config_cache_verify(), off the bring-up path.
+ *
+ * A firmware update only misses the cache if it changes bcdDevice. The
+ * reference firmware derives it from its Memfault software version; with
+ * firmware that keeps the USB stack's default, a changed configuration is
+ * only picked up by mds_config_cache_verify().
+ *
+ * The cache is in memory and can be persisted to a file, which is rewritten
+ * whenever an entry is stored. Writes are atomic (write to a temporary file,
+ * then rename) with mode 0600, since the file holds authorization headers.
+ * All functions are thread-safe.
+ *
+ * Usage:
+ *   mds_config_cache_open("/var/lib/gateway/mds-config.cache", 256, &cache);
+ *   bool cached;
+ *   mds_config_cache_read_config(cache, session, serial, bcd, &config, &cached);
+ *   mds_stream_enable(session);
+ *   ...
+ *   if (cached) {
+ *       mds_config_cache_verify(cache, session, serial, bcd, &config);
+ *   }
+ */
+
+#ifndef MEMFAULT_MDS_CONFIG_CACHE_H
+#define MEMFAULT_MDS_CONFIG_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "memfault_hid/mds_protocol.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Opaque handle to a device config cache
+ */
+typedef struct mds_config_cache mds_config_cache_t;
+
+/**
+ * @brief Config cache statistics
+ */
+typedef struct {
+    /** Devices currently cached */
+    size_t entries;
+
+    /** Lookups answered from the cache */
+    size_t hits;
+
+    /** Lookups that had to read the device */
+    size_t misses;
+
+    /** Verifications that found the device config changed */
+    size_t verify_mismatches;
+} mds_config_cache_stats_t;
+
+/**
+ * @brief Open a config cache
+ *
+ * If path names an existing cache file its entries are loaded; a missing
+ * or corrupt file starts an empty cache.
+ *
+ * @param path Cache file for persistence, or NULL for memory only
+ * @param max_entries Devices to remember (least recently used are dropped)
+ * @param cache Pointer to receive cache handle
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_config_cache_open(const char *path, size_t max_entries, mds_config_cache_t **cache);
+
+/**
+ * @brief Close a config cache, saving it first if it has a file
+ *
+ * @param cache Cache handle
+ */
+void mds_config_cache_close(mds_config_cache_t *cache);
+
+/**
+ * @brief Write the cache to its file
+ *
+ * Called by mds_config_cache_store() and mds_config_cache_close(); only
+ * needed to retry after a failed write.
+ *
+ * @param cache Cache handle
+ *
+ * @return 0 on success (or no file configured), negative error code otherwise
+ */
+int mds_config_cache_save(mds_config_cache_t *cache);
+
+/**
+ * @brief Look up a device's cached configuration
+ *
+ * @param cache Cache handle
+ * @param serial_number USB serial number
+ * @param release_number USB device release number (bcdDevice)
+ * @param config Pointer to receive the configuration
+ *
+ * @return 0 on success, -ENOENT if not cached, negative error code otherwise
+ */
+int mds_config_cache_lookup(mds_config_cache_t *cache,
+                            const char *serial_number,
+                            uint16_t release_number,
+                            mds_device_config_t *config);
+
+/**
+ * @brief Store a device's configuration
+ *
+ * Replaces entries for other release numbers of the same device. With a
+ * cache file, the file is rewritten before returning.
+ *
+ * @param cache Cache handle
+ * @param serial_number USB serial number
+ * @param release_number USB device release number (bcdDevice)
+ * @param config Configuration to store
+ *
+ * @return 0 on success, negative error code otherwise (if only the file
+ *         write failed, the entry is still cached in memory)
+ */
+int mds_config_cache_store(mds_config_cache_t *cache,
+                           const char *serial_number,
+                           uint16_t release_number,
+                           const mds_device_config_t *config);
+
+/**
+ * @brief Read a device's configuration, from the cache when possible
+ *
+ * On a hit the device is not touched. On a miss mds_read_device_config()
+ * is called and the result stored. Devices with an empty serial number are
+ * never cached.
+ *
+ * @param cache Cache handle
+ * @param session MDS session of the device
+ * @param serial_number USB serial number
+ * @param release_number USB device release number (bcdDevice)
+ * @param config Pointer to receive the configuration
+ * @param cached Pointer to receive whether config came from the cache (may be NULL)
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_config_cache_read_config(mds_config_cache_t *cache,
+                                 mds_session_t *session,
+                                 const char *serial_number,
+                                 uint16_t release_number,
+                                 mds_device_config_t *config,
+                                 bool *cached);
+
+/**
+ * @brief Check a cached configuration against the device
+ *
+ * Reads the configuration from the device and updates both the cache and
+ * config if it changed (for example a new project key). Meant to run after
+ * streaming has started from a cached configuration. It uses the device
+ * handle, so call it from the thread that owns the session, between
+ * mds_stream_process() calls.
+ *
+ * @param cache Cache handle
+ * @param session MDS session of the device
+ * @param serial_number USB serial number
+ * @param release_number USB device release number (bcdDevice)
+ * @param config Configuration in use, updated in place if it changed
+ *
+ * @return 0 if unchanged, 1 if config was updated, negative error code otherwise
+ */
+int mds_config_cache_verify(mds_config_cache_t *cache,
+                            mds_session_t *session,
+                            const char *serial_number,
+                            uint16_t release_number,
+                            mds_device_config_t *config);
+
+/**
+ * @brief Get config cache statistics
+ *
+ * @param cache Cache handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_config_cache_get_stats(mds_config_cache_t *cache, mds_config_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEMFAULT_MDS_CONFIG_CACHE_H */
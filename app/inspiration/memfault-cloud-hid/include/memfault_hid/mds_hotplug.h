@@ -0,0 +1,216 @@
+/**
+ * @file mds_hotplug.h
+ * @brief Hotplug monitor for MDS-capable HID devices
+ *
+ * Delivers add and remove events for hidraw nodes whose report descriptor
+ * declares the MDS interface (MEMFAULT_HID_MDS_USAGE_PAGE / MEMFAULT_HID_MDS_USAGE),
+ * instead of polling memfault_hid_enumerate(). Optionally brings up a
+ * streaming session for each added device: open, read the device config
+ * and enable streaming, so a freshly plugged device starts draining without
+ * any gateway round trip. With a config cache, a session may start from a
+ * cached config; the monitor checks it against the device a few seconds
+ * later, from mds_hotplug_process(), and reports a change.
+ *
+ * This module uses udev and is only available on Linux; elsewhere
+ * mds_hotplug_create() returns -ENOTSUP. libudev is already a dependency
+ * of the hidapi hidraw backend.
+ *
+ * Usage:
+ *   mds_hotplug_config_t config = {
+ *       .auto_session = true,
+ *       .stream_mode = MDS_STREAM_MODE_ENABLED | MDS_STREAM_MODE_FLAG_RELIABLE,
+ *       .enumerate_existing = true,
+ *   };
+ *   mds_hotplug_create(&config, on_hotplug, gateway, &hotplug);
+ *   while (running) {
+ *       mds_hotplug_process(hotplug, 1000);
+ *   }
+ */
+
+#ifndef MEMFAULT_MDS_HOTPLUG_H
+#define MEMFAULT_MDS_HOTPLUG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "memfault_hid/mds_config_cache.h"
+#include "memfault_hid/mds_protocol.h"
+#include "memfault_hid/memfault_hid.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Opaque handle to a hotplug monitor
+ */
+typedef struct mds_hotplug mds_hotplug_t;
+
+/**
+ * @brief Hotplug event types
+ */
+typedef enum {
+    MDS_HOTPLUG_EVENT_ADDED = 0,
+    MDS_HOTPLUG_EVENT_REMOVED = 1,
+    /**
+     * A cached config handed out with MDS_HOTPLUG_EVENT_ADDED no longer
+     * matches the device (for example a new project key). config holds the
+     * new configuration, already stored in the cache; pass it to
+     * mds_stream_process() for this device from now on. device and session
+     * are NULL.
+     */
+    MDS_HOTPLUG_EVENT_CONFIG_CHANGED = 2
+} mds_hotplug_event_type_t;
+
+/**
+ * @brief Hotplug event
+ *
+ * Pointers are only valid during the callback, except device and session
+ * (see below).
+ */
+typedef struct {
+    /** Event type */
+    mds_hotplug_event_type_t type;
+
+    /** hidraw device node, for memfault_hid_open_path() */
+    const char *path;
+
+    /** USB Vendor ID */
+    uint16_t vendor_id;
+
+    /** USB Product ID */
+    uint16_t product_id;
+
+    /** USB device release number (bcdDevice, 0 if unknown) */
+    uint16_t release_number;
+
+    /** USB serial number (empty if the device has none) */
+    const char *serial_number;
+
+    /**
+     * Device and session brought up for an added device when auto_session
+     * is enabled, NULL otherwise. Ownership passes to the callback, which
+     * must eventually call mds_session_destroy() and memfault_hid_close().
+     */
+    memfault_hid_device_t *device;
+    mds_session_t *session;
+
+    /**
+     * Device configuration read during bring-up, or the new configuration
+     * for MDS_HOTPLUG_EVENT_CONFIG_CHANGED (NULL otherwise)
+     */
+    const mds_device_config_t *config;
+
+    /**
+     * Whether config came from config_cache rather than the device. The
+     * monitor verifies it in the background and sends
+     * MDS_HOTPLUG_EVENT_CONFIG_CHANGED if it differs.
+     */
+    bool config_cached;
+
+    /** Stream mode that was enabled, after dropping unsupported flags */
+    uint8_t stream_mode;
+
+    /** Bring-up error, 0 if none (device and session are then NULL) */
+    int error;
+} mds_hotplug_event_t;
+
+/**
+ * @brief Hotplug event callback
+ *
+ * Called from mds_hotplug_process().
+ *
+ * @param event Event details
+ * @param user_data User data from mds_hotplug_create()
+ */
+typedef void (*mds_hotplug_callback_t)(const mds_hotplug_event_t *event, void *user_data);
+
+/**
+ * @brief Hotplug monitor configuration
+ */
+typedef struct {
+    /** USB Vendor ID to match (0x0000 for all vendors) */
+    uint16_t vendor_id;
+
+    /** USB Product ID to match (0x0000 for all products) */
+    uint16_t product_id;
+
+    /** Open added devices, read their config and enable streaming */
+    bool auto_session;
+
+    /**
+     * Stream mode to enable (0 for MDS_STREAM_MODE_ENABLED). Flags the
+     * device doesn't advertise in its supported features are dropped.
+     */
+    uint8_t stream_mode;
+
+    /** Report devices already present as added, on the first mds_hotplug_process() */
+    bool enumerate_existing;
+
+    /**
+     * Device config cache used during bring-up (NULL to always read the
+     * device). Keyed by serial number and release number.
+     */
+    mds_config_cache_t *config_cache;
+} mds_hotplug_config_t;
+
+/**
+ * @brief Create a hotplug monitor
+ *
+ * memfault_hid_init() must have been called if auto_session is enabled.
+ *
+ * @param config Monitor configuration
+ * @param callback Event callback
+ * @param user_data User data passed to the callback
+ * @param hotplug Pointer to receive monitor handle
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -ENOTSUP if hotplug monitoring is not available on this platform
+ */
+int mds_hotplug_create(const mds_hotplug_config_t *config,
+                       mds_hotplug_callback_t callback,
+                       void *user_data,
+                       mds_hotplug_t **hotplug);
+
+/**
+ * @brief Destroy a hotplug monitor
+ *
+ * Sessions handed to the callback are not affected.
+ *
+ * @param hotplug Monitor handle
+ */
+void mds_hotplug_destroy(mds_hotplug_t *hotplug);
+
+/**
+ * @brief Get the file descriptor to wait on
+ *
+ * Readable when events are pending; lets the monitor share an event loop
+ * with other descriptors. Call mds_hotplug_process() with timeout 0 when it
+ * becomes readable.
+ *
+ * @param hotplug Monitor handle
+ *
+ * @return File descriptor, or negative error code
+ */
+int mds_hotplug_get_fd(mds_hotplug_t *hotplug);
+
+/**
+ * @brief Wait for and handle hotplug events
+ *
+ * Waits up to timeout_ms for events, then handles every pending one,
+ * invoking the callback. Session bring-up runs on the calling thread, and
+ * so do checks of cached configs that are due; the wait is cut short when
+ * one is. A check opens a second handle to the device and only reads
+ * feature reports, so it does not disturb the session streaming from it.
+ *
+ * @param hotplug Monitor handle
+ * @param timeout_ms Timeout in milliseconds (0 = don't wait, -1 = infinite)
+ *
+ * @return Number of events delivered, or negative error code
+ */
+int mds_hotplug_process(mds_hotplug_t *hotplug, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEMFAULT_MDS_HOTPLUG_H */
@@ -51,6 +51,12 @@ typedef struct memfault_hid_device memfault_hid_device_t;
 /** Input Report: Stream data packets (chunk data) */
 #define MDS_REPORT_ID_STREAM_DATA           0x06
 
+/** Output Report: Stream acknowledgement (reliable mode only) */
+#define MDS_REPORT_ID_STREAM_ACK            0x07
+
+/** Feature Report: Device configuration as TLV entries (MDS_FEATURE_DEVICE_CONFIG_REPORT) */
+#define MDS_REPORT_ID_DEVICE_CONFIG         0x08
+
 /* ============================================================================
  * Constants
  * ========================================================================== */
@@ -67,6 +73,41 @@ typedef struct memfault_hid_device memfault_hid_device_t;
 /** Maximum chunk data per packet (after sequence byte) */
 #define MDS_MAX_CHUNK_DATA_LEN              63
 
+/** Stream ack payload length: sequence (1) + received bitmap (4) */
+#define MDS_STREAM_ACK_LEN                  5
+
+/** Reports the device keeps for retransmission in reliable mode */
+#define MDS_RELIABLE_WINDOW_SIZE            8
+
+/** Device config entry types: type (1) + length (1) + value */
+#define MDS_CONFIG_TLV_SUPPORTED_FEATURES   0x01
+#define MDS_CONFIG_TLV_DEVICE_IDENTIFIER    0x02
+#define MDS_CONFIG_TLV_DATA_URI             0x03
+#define MDS_CONFIG_TLV_AUTHORIZATION        0x04
+
+/** Device config report length when every entry is at its maximum length */
+#define MDS_DEVICE_CONFIG_REPORT_LEN \
+    (4 * 2 + 4 + MDS_MAX_DEVICE_ID_LEN + MDS_MAX_URI_LEN + MDS_MAX_AUTH_LEN)
+
+/** Most packets returned by one mds_stream_read_packets() call */
+#define MDS_STREAM_READ_MAX_PACKETS         32
+
+/* ============================================================================
+ * Supported Features
+ * ========================================================================== */
+
+/** Device supports reliable streaming (MDS_STREAM_MODE_FLAG_RELIABLE) */
+#define MDS_FEATURE_RELIABLE_STREAM         (1u << 5)
+
+/** Device supports 16-bit sequence numbers (MDS_STREAM_MODE_FLAG_EXTENDED_SEQ) */
+#define MDS_FEATURE_EXTENDED_SEQUENCE       (1u << 6)
+
+/** Device supports compressed streams (MDS_STREAM_MODE_FLAG_COMPRESSED) */
+#define MDS_FEATURE_COMPRESSED_STREAM       (1u << 7)
+
+/** Device serves its whole configuration in one report (MDS_REPORT_ID_DEVICE_CONFIG) */
+#define MDS_FEATURE_DEVICE_CONFIG_REPORT    (1u << 8)
+
 /* ============================================================================
  * Stream Control Modes
  * ========================================================================== */
@@ -77,6 +118,30 @@ typedef struct memfault_hid_device memfault_hid_device_t;
 /** Stream control mode: Streaming enabled */
 #define MDS_STREAM_MODE_ENABLED             0x01
 
+/** Stream control mode: Streaming enabled, draining coredumps, then events, then logs */
+#define MDS_STREAM_MODE_PRIORITY            0x02
+
+/**
+ * Stream control flag: Reliable streaming, OR'ed with an enabled mode.
+ * The host must acknowledge received packets with stream ack reports and
+ * the device retransmits packets reported missing.
+ */
+#define MDS_STREAM_MODE_FLAG_RELIABLE       0x80
+
+/**
+ * Stream control flag: Extended header with a 16-bit sequence number,
+ * OR'ed with an enabled mode. Only valid if the device advertises
+ * MDS_FEATURE_EXTENDED_SEQUENCE.
+ */
+#define MDS_STREAM_MODE_FLAG_EXTENDED_SEQ   0x40
+
+/**
+ * Stream control flag: Compressed stream, OR'ed with an enabled mode. Only
+ * valid if the device advertises MDS_FEATURE_COMPRESSED_STREAM. Implies the
+ * extended header, whose length byte delimits frame slices.
+ */
+#define MDS_STREAM_MODE_FLAG_COMPRESSED     0x20
+
 /* ============================================================================
  * Stream Data Packet Format
  * ========================================================================== */
@@ -87,6 +152,41 @@ typedef struct memfault_hid_device memfault_hid_device_t;
 /** Sequence counter max value (wraps at 31) */
 #define MDS_SEQUENCE_MAX                    31
 
+/** Extended sequence counter mask (bytes 0-1, little-endian) */
+#define MDS_SEQUENCE_MASK_EXT               0xFFFF
+
+/** Extended sequence counter max value (wraps at 65535) */
+#define MDS_SEQUENCE_MAX_EXT                65535
+
+/** Extended packet header: sequence (2) + payload length (1) */
+#define MDS_EXT_HEADER_LEN                  3
+
+/* ============================================================================
+ * Compressed Stream Format
+ * ========================================================================== */
+
+/*
+ * In compressed mode each packet payload starts with a frame control byte
+ * followed by a slice of a frame. A frame carries one Memfault chunk:
+ * raw chunk length (2 bytes, little-endian) followed by either an LZ4 block
+ * or, if MDS_FRAME_CTRL_STORED is set, the raw chunk bytes.
+ */
+
+/** Frame control: first slice of a frame */
+#define MDS_FRAME_CTRL_START                0x01
+
+/** Frame control: last slice of a frame */
+#define MDS_FRAME_CTRL_END                  0x02
+
+/** Frame control: frame body is stored uncompressed */
+#define MDS_FRAME_CTRL_STORED               0x04
+
+/** Frame header: raw chunk length */
+#define MDS_FRAME_HEADER_LEN                2
+
+/** Maximum raw chunk length carried in one frame */
+#define MDS_MAX_FRAME_LEN                   4096
+
 /* ============================================================================
  * Data Structures
  * ========================================================================== */
@@ -117,18 +217,40 @@ typedef struct {
  * Packet format for diagnostic chunk data.
  * Byte 0: Sequence counter (bits 0-4) + reserved (bits 5-7)
  * Byte 1+: Chunk data payload
+ *
+ * Extended packet format (MDS_STREAM_MODE_FLAG_EXTENDED_SEQ):
+ * Bytes 0-1: Sequence counter (little-endian)
+ * Byte 2: Payload length
+ * Byte 3+: Chunk data payload
  */
 typedef struct {
-    /** Sequence counter (0-31, wraps around) */
-    uint8_t sequence;
+    /** Sequence counter (0-31, or 0-65535 in extended mode, wraps around) */
+    uint16_t sequence;
 
-    /** Chunk data payload */
+    /** Chunk data payload (truncated for reports larger than MEMFAULT_HID_MAX_REPORT_SIZE) */
     uint8_t data[MDS_MAX_CHUNK_DATA_LEN];
 
     /** Length of valid data in the data array */
     size_t data_len;
 } mds_stream_packet_t;
 
+/**
+ * @brief Borrowed view of a stream data packet
+ *
+ * Same fields as mds_stream_packet_t, but data points into the buffer the
+ * packet was parsed from instead of holding a copy.
+ */
+typedef struct {
+    /** Sequence counter (0-31, or 0-65535 in extended mode, wraps around) */
+    uint16_t sequence;
+
+    /** Chunk data payload, inside the parsed buffer (not limited to MDS_MAX_CHUNK_DATA_LEN) */
+    const uint8_t *data;
+
+    /** Length of valid data */
+    size_t data_len;
+} mds_stream_packet_view_t;
+
 /**
  * @brief Callback for uploading chunk data to the cloud
  *
@@ -143,6 +265,9 @@ typedef struct {
  *   - Content-Type: application/octet-stream
  * - Body: chunk_data (chunk_len bytes)
  *
+ * chunk_data points into the session's receive buffers and is only valid
+ * until the callback returns; copy it to keep it longer.
+ *
  * @param uri Data URI to upload to (from device config)
  * @param auth_header Authorization header (format: "HeaderName:HeaderValue")
  * @param chunk_data Chunk data bytes to upload
@@ -157,6 +282,46 @@ typedef int (*mds_chunk_upload_callback_t)(const char *uri,
                                             size_t chunk_len,
                                             void *user_data);
 
+/**
+ * @brief Callback for session diagnostic messages
+ *
+ * Invoked with a human-readable message, e.g. when a sequence gap or a
+ * duplicate packet is detected.
+ *
+ * @param message Null-terminated message (valid only during the call)
+ * @param user_data User-provided context pointer
+ */
+typedef void (*mds_log_callback_t)(const char *message, void *user_data);
+
+/**
+ * @brief Stream reception statistics
+ */
+typedef struct {
+    /** Stream data packets received, including duplicates */
+    size_t packets_received;
+
+    /** Sequence discontinuities (one per run of missing packets) */
+    size_t sequence_gaps;
+
+    /** Packets estimated lost from sequence gaps (exact in extended mode) */
+    size_t packets_lost;
+
+    /** Packets received more than once */
+    size_t duplicates;
+
+    /** Packets that filled a gap after retransmission (reliable mode) */
+    size_t packets_recovered;
+
+    /** Compressed frames discarded after loss or corruption (compressed mode) */
+    size_t frames_dropped;
+
+    /** Frame body bytes received (compressed mode) */
+    size_t bytes_compressed;
+
+    /** Chunk bytes recovered from frames (compressed mode) */
+    size_t bytes_decompressed;
+} mds_session_stats_t;
+
 /* ============================================================================
  * MDS Session Management
  * ========================================================================== */
@@ -184,6 +349,41 @@ int mds_session_create(memfault_hid_device_t *device,
  */
 void mds_session_destroy(mds_session_t *session);
 
+/**
+ * @brief Get stream reception statistics
+ *
+ * @param session MDS session handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_session_get_stats(mds_session_t *session, mds_session_stats_t *stats);
+
+/**
+ * @brief Reset stream reception statistics
+ *
+ * @param session MDS session handle
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_session_reset_stats(mds_session_t *session);
+
+/**
+ * @brief Set log callback
+ *
+ * Registers a callback for diagnostic messages such as detected sequence
+ * gaps and duplicates.
+ *
+ * @param session MDS session handle
+ * @param callback Log callback function (NULL to disable)
+ * @param user_data User context pointer passed to callback
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_set_log_callback(mds_session_t *session,
+                         mds_log_callback_t callback,
+                         void *user_data);
+
 /* ============================================================================
  * Device Configuration
  * ========================================================================== */
@@ -192,7 +392,9 @@ void mds_session_destroy(mds_session_t *session);
  * @brief Read device configuration from the device
  *
  * Reads the supported features, device identifier, data URI, and
- * authorization header from the device using feature reports.
+ * authorization header from the device using feature reports. Devices with
+ * MDS_FEATURE_DEVICE_CONFIG_REPORT serve all of them in one report; when
+ * the report descriptor declares it that is the only transfer made.
  *
  * @param session MDS session handle
  * @param config Pointer to receive device configuration
@@ -279,6 +481,42 @@ int mds_stream_enable(mds_session_t *session);
  */
 int mds_stream_disable(mds_session_t *session);
 
+/**
+ * @brief Set the stream control mode
+ *
+ * Sends a stream control output report with an explicit mode byte. Use
+ * MDS_STREAM_MODE_PRIORITY to have the device drain pending coredumps
+ * before queued events and logs. OR in MDS_STREAM_MODE_FLAG_RELIABLE to
+ * enable acknowledged streaming; mds_stream_process() then reorders
+ * packets and sends acknowledgements automatically.
+ *
+ * If the device does not take the report within a second, the report stays
+ * queued and may still reach it, so the session no longer knows which mode
+ * the device streams in. Reading and processing stream data then fails
+ * with -ENOTCONN until a later call (for example a retry with the same
+ * mode) succeeds.
+ *
+ * @param session MDS session handle
+ * @param mode One of the MDS_STREAM_MODE_* values
+ *
+ * @return 0 on success, negative error code otherwise
+ *         MEMFAULT_HID_ERROR_TIMEOUT if the device did not take the report
+ */
+int mds_stream_set_mode(mds_session_t *session, uint8_t mode);
+
+/**
+ * @brief Send a stream acknowledgement
+ *
+ * Reports the highest contiguous sequence number received and which later
+ * packets are already buffered, so the device resends only the gaps.
+ * Only meaningful in reliable mode; mds_stream_process() calls this itself.
+ *
+ * @param session MDS session handle
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_stream_send_ack(mds_session_t *session);
+
 /* ============================================================================
  * Stream Data Reception
  * ========================================================================== */
@@ -295,11 +533,36 @@ int mds_stream_disable(mds_session_t *session);
  *
  * @return 0 on success, negative error code otherwise
  *         -ETIMEDOUT if no data available within timeout
+ *         -ENOTCONN if the stream mode is unknown, see mds_stream_set_mode()
  */
 int mds_stream_read_packet(mds_session_t *session,
                            mds_stream_packet_t *packet,
                            int timeout_ms);
 
+/**
+ * @brief Read every immediately available stream data packet in one call
+ *
+ * Batch counterpart of mds_stream_read_packet(): waits up to timeout_ms for
+ * the first packet, then drains packets already queued by the OS without
+ * blocking. Meant for the backlog of Stream Data reports that builds up
+ * after a reconnect. Reports that are not valid stream data are skipped.
+ *
+ * @param session MDS session handle
+ * @param packets Array to receive the packets, in arrival order
+ * @param max_packets Number of entries in packets (at most
+ *                    MDS_STREAM_READ_MAX_PACKETS are read per call)
+ * @param timeout_ms Timeout for the first packet in milliseconds
+ *                   (0 = non-blocking, -1 = infinite)
+ *
+ * @return Number of packets read (at least 1) on success, negative error
+ *         code otherwise (-ENOTCONN if the stream mode is unknown, see
+ *         mds_stream_set_mode())
+ */
+int mds_stream_read_packets(mds_session_t *session,
+                            mds_stream_packet_t *packets,
+                            size_t max_packets,
+                            int timeout_ms);
+
 /* ============================================================================
  * Chunk Upload
  * ========================================================================== */
@@ -330,15 +593,24 @@ int mds_set_upload_callback(mds_session_t *session,
  *
  * Call this in a loop after enabling streaming. It will:
  * 1. Read a packet from the stream
- * 2. Validate the sequence number (logs warning if invalid)
+ * 2. Validate the sequence number (counted in mds_session_stats_t and
+ *    reported through the log callback if invalid)
  * 3. Upload the chunk via the callback (if configured)
  *
+ * In reliable mode, out-of-order packets are held until the gap before them
+ * is retransmitted, then uploaded in sequence order; a single call may
+ * therefore upload zero or several chunks.
+ *
+ * In compressed mode, packets are reassembled into frames and each frame is
+ * decompressed and uploaded as one chunk once its last slice arrives.
+ *
  * @param session MDS session handle
  * @param config Device configuration (contains URI and auth)
  * @param timeout_ms Timeout in milliseconds for reading packets
  *
  * @return 0 on success, negative error code otherwise
  *         -ETIMEDOUT if no data available within timeout
+ *         -ENOTCONN if the stream mode is unknown, see mds_stream_set_mode()
  *         Returns upload callback error code if upload fails
  */
 int mds_stream_process(mds_session_t *session,
@@ -373,6 +645,43 @@ static inline uint8_t mds_extract_sequence(uint8_t byte0) {
     return byte0 & MDS_SEQUENCE_MASK;
 }
 
+/**
+ * @brief Validate extended (16-bit) sequence number
+ *
+ * @param prev_seq Previous sequence number
+ * @param new_seq New sequence number
+ *
+ * @return true if sequence is valid (next in sequence)
+ *         false if packet was dropped or duplicated
+ */
+bool mds_validate_sequence_ext(uint16_t prev_seq, uint16_t new_seq);
+
+/**
+ * @brief Count packets lost between two sequence numbers
+ *
+ * With the 5-bit counter a gap of 32 or more packets aliases to a smaller
+ * value; use the extended sequence mode for an exact count at high rates.
+ *
+ * @param prev_seq Previous sequence number
+ * @param new_seq New sequence number
+ * @param extended true if both values are 16-bit extended sequence numbers
+ *
+ * @return Number of packets missing between prev_seq and new_seq
+ *         (0 if new_seq directly follows prev_seq)
+ */
+uint16_t mds_count_lost_packets(uint16_t prev_seq, uint16_t new_seq, bool extended);
+
+/**
+ * @brief Extract extended sequence number from packet bytes 0-1
+ *
+ * @param buffer First bytes of an extended stream packet (at least 2)
+ *
+ * @return Sequence number (0-65535)
+ */
+static inline uint16_t mds_extract_sequence_ext(const uint8_t *buffer) {
+    return (uint16_t)(buffer[0] | ((uint16_t)buffer[1] << 8));
+}
+
 /* ============================================================================
  * Buffer-based API for FFI/External HID Transport
  * ========================================================================== */
@@ -430,6 +739,22 @@ int mds_parse_data_uri(const uint8_t *buffer, size_t buffer_len,
 int mds_parse_authorization(const uint8_t *buffer, size_t buffer_len,
                              char *auth, size_t max_len);
 
+/**
+ * @brief Parse the device config report
+ *
+ * The report is a sequence of type (1) + length (1) + value entries
+ * (MDS_CONFIG_TLV_*). Unknown types are skipped and a zero type ends the
+ * list. All four MDS_CONFIG_TLV_* entries must be present.
+ *
+ * @param buffer Feature report data (without Report ID prefix)
+ * @param buffer_len Length of buffer
+ * @param config Pointer to receive device configuration
+ *
+ * @return 0 on success, -EINVAL if truncated or an entry is missing
+ */
+int mds_parse_device_config(const uint8_t *buffer, size_t buffer_len,
+                            mds_device_config_t *config);
+
 /**
  * @brief Build stream control output report
  *
@@ -443,6 +768,30 @@ int mds_parse_authorization(const uint8_t *buffer, size_t buffer_len,
  */
 int mds_build_stream_control(bool enable, uint8_t *buffer, size_t buffer_len);
 
+/**
+ * @brief Build stream control output report for a specific mode
+ *
+ * @param mode One of the MDS_STREAM_MODE_* values
+ * @param buffer Buffer to receive output report data (without Report ID prefix)
+ * @param buffer_len Length of buffer (should be at least 1)
+ *
+ * @return Number of bytes written, or negative error code
+ */
+int mds_build_stream_control_mode(uint8_t mode, uint8_t *buffer, size_t buffer_len);
+
+/**
+ * @brief Build stream ack output report
+ *
+ * @param ack_sequence Highest contiguous sequence number received
+ * @param received Bit i set if sequence (ack_sequence + 1 + i) was received
+ * @param buffer Buffer to receive output report data (without Report ID prefix)
+ * @param buffer_len Length of buffer (should be at least MDS_STREAM_ACK_LEN)
+ *
+ * @return Number of bytes written, or negative error code
+ */
+int mds_build_stream_ack(uint8_t ack_sequence, uint32_t received,
+                         uint8_t *buffer, size_t buffer_len);
+
 /**
  * @brief Parse stream data packet from input report buffer
  *
@@ -457,6 +806,53 @@ int mds_build_stream_control(bool enable, uint8_t *buffer, size_t buffer_len);
 int mds_parse_stream_packet(const uint8_t *buffer, size_t buffer_len,
                              mds_stream_packet_t *packet);
 
+/**
+ * @brief Parse extended stream data packet from input report buffer
+ *
+ * Like mds_parse_stream_packet(), for streams enabled with
+ * MDS_STREAM_MODE_FLAG_EXTENDED_SEQ. The payload length byte is honoured,
+ * so report padding is not included in the chunk data.
+ *
+ * @param buffer Input report data (without Report ID prefix)
+ * @param buffer_len Length of buffer
+ * @param packet Pointer to receive parsed packet
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_parse_stream_packet_ext(const uint8_t *buffer, size_t buffer_len,
+                                 mds_stream_packet_t *packet);
+
+/**
+ * @brief Parse a stream data packet in place
+ *
+ * Zero-copy counterpart of mds_parse_stream_packet() and
+ * mds_parse_stream_packet_ext(): the view's data points into buffer, which
+ * must outlive it. Pairs with memfault_hid_read_report_view().
+ *
+ * @param buffer Input report data (without Report ID prefix)
+ * @param buffer_len Length of buffer
+ * @param extended true for streams enabled with MDS_STREAM_MODE_FLAG_EXTENDED_SEQ
+ * @param view Pointer to receive the packet view
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_parse_stream_packet_view(const uint8_t *buffer, size_t buffer_len,
+                                 bool extended, mds_stream_packet_view_t *view);
+
+/**
+ * @brief Decode a complete compressed stream frame
+ *
+ * @param frame Reassembled frame (raw length header + body)
+ * @param frame_len Length of frame
+ * @param stored true if the frame control byte had MDS_FRAME_CTRL_STORED set
+ * @param out Buffer to receive the chunk
+ * @param out_len Length of out (MDS_MAX_FRAME_LEN is always sufficient)
+ *
+ * @return Chunk length on success, negative error code otherwise
+ */
+int mds_decode_frame(const uint8_t *frame, size_t frame_len, bool stored,
+                     uint8_t *out, size_t out_len);
+
 /**
  * @brief Get last sequence number from session
  *
@@ -464,19 +860,21 @@ int mds_parse_stream_packet(const uint8_t *buffer, size_t buffer_len,
  *
  * @param session MDS session handle
  *
- * @return Last received sequence number (0-31)
+ * @return Last received sequence number (0-31, or 0-65535 in extended mode)
  */
-uint8_t mds_get_last_sequence(mds_session_t *session);
+uint16_t mds_get_last_sequence(mds_session_t *session);
 
 /**
  * @brief Update last sequence number in session
  *
  * Call this after successfully processing a packet when using buffer-based API.
+ * The packet is accounted in the session statistics like packets read by
+ * mds_stream_read_packet().
  *
  * @param session MDS session handle
  * @param sequence New sequence number to store
  */
-void mds_update_last_sequence(mds_session_t *session, uint8_t sequence);
+void mds_update_last_sequence(mds_session_t *session, uint16_t sequence);
 
 #ifdef __cplusplus
 }
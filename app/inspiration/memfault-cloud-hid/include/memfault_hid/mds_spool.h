@@ -0,0 +1,159 @@
+/**
+ * @file mds_spool.h
+ * @brief Disk-backed spool for chunks that could not be uploaded
+ *
+ * The spool is a fixed-size, memory-mapped ring of chunk records in a single
+ * file, typically one per gateway. Records are appended at the tail and
+ * consumed from the head; when the spool is full the oldest records are
+ * evicted to make room.
+ *
+ * Crash safety: a record is written and flushed to disk before the header
+ * that makes it visible is updated. The header is kept in two alternating
+ * slots with a sequence number and CRC, so an interrupted update falls back
+ * to the previous state. mds_spool_append() returning 0 means the chunk is
+ * on disk.
+ *
+ * This module uses POSIX mmap()/msync() and is not available on Windows.
+ *
+ * Usage with the uploader:
+ *   mds_spool_t *spool;
+ *   mds_spool_open("/var/lib/gateway/chunks.spool", 16 * 1024 * 1024, &spool);
+ *   mds_uploader_set_spool(uploader, spool);
+ */
+
+#ifndef MEMFAULT_MDS_SPOOL_H
+#define MEMFAULT_MDS_SPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Smallest spool capacity accepted by mds_spool_open() */
+#define MDS_SPOOL_MIN_CAPACITY      (64 * 1024)
+
+/**
+ * @brief Opaque handle to a chunk spool
+ */
+typedef struct mds_spool mds_spool_t;
+
+/**
+ * @brief Spool statistics
+ */
+typedef struct {
+    /** Chunks currently spooled */
+    size_t chunks;
+
+    /** Bytes of the ring in use, including record headers */
+    size_t bytes_used;
+
+    /** Size of the ring */
+    size_t capacity;
+
+    /** Chunks evicted to make room since the spool was opened */
+    size_t chunks_evicted;
+} mds_spool_stats_t;
+
+/**
+ * @brief Open or create a spool file
+ *
+ * If the file exists and holds a valid spool, its contents are recovered
+ * (and its original capacity kept). Otherwise a new empty spool of the given
+ * capacity is created.
+ *
+ * @param path Path of the spool file
+ * @param capacity Ring size in bytes (at least MDS_SPOOL_MIN_CAPACITY)
+ * @param spool Pointer to receive spool handle
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_spool_open(const char *path, size_t capacity, mds_spool_t **spool);
+
+/**
+ * @brief Close a spool
+ *
+ * Spooled chunks stay on disk and are recovered by the next mds_spool_open().
+ *
+ * @param spool Spool handle to close
+ */
+void mds_spool_close(mds_spool_t *spool);
+
+/**
+ * @brief Append a chunk to the spool
+ *
+ * Evicts the oldest chunks if needed. Returns only after the chunk has been
+ * flushed to disk.
+ *
+ * @param spool Spool handle
+ * @param uri Data URI the chunk is destined for
+ * @param auth_header Authorization header ("HeaderName:HeaderValue")
+ * @param chunk_data Chunk data bytes
+ * @param chunk_len Length of chunk data
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -EMSGSIZE if the chunk can never fit in the spool
+ */
+int mds_spool_append(mds_spool_t *spool,
+                     const char *uri,
+                     const char *auth_header,
+                     const uint8_t *chunk_data,
+                     size_t chunk_len);
+
+/**
+ * @brief Get the oldest spooled chunk without removing it
+ *
+ * The returned pointers reference the mapped file and stay valid until the
+ * next mds_spool_append(), mds_spool_pop() or mds_spool_close().
+ *
+ * @param spool Spool handle
+ * @param uri Pointer to receive the data URI
+ * @param auth_header Pointer to receive the authorization header
+ * @param chunk_data Pointer to receive the chunk data
+ * @param chunk_len Pointer to receive the chunk length
+ *
+ * @return 0 on success, -ENOENT if the spool is empty
+ */
+int mds_spool_peek(mds_spool_t *spool,
+                   const char **uri,
+                   const char **auth_header,
+                   const uint8_t **chunk_data,
+                   size_t *chunk_len);
+
+/**
+ * @brief Remove the oldest spooled chunk
+ *
+ * Call after the chunk returned by mds_spool_peek() has been uploaded.
+ *
+ * @param spool Spool handle
+ *
+ * @return 0 on success, -ENOENT if the spool is empty
+ */
+int mds_spool_pop(mds_spool_t *spool);
+
+/**
+ * @brief Check whether the spool holds any chunks
+ *
+ * @param spool Spool handle
+ *
+ * @return true if empty (or spool is NULL)
+ */
+bool mds_spool_is_empty(mds_spool_t *spool);
+
+/**
+ * @brief Get spool statistics
+ *
+ * @param spool Spool handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_spool_get_stats(mds_spool_t *spool, mds_spool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEMFAULT_MDS_SPOOL_H */
@@ -3,13 +3,39 @@
  * @brief Optional HTTP upload implementation for MDS chunks
  *
  * This header provides a ready-to-use HTTP uploader built on libcurl.
- * This is optional and only available if BUILD_MDS_UPLOAD is enabled.
+ * This is optional and only available if BUILD_MDS_UPLOAD is enabled. It
+ * links against libcurl, zlib (request body compression) and pthreads.
  *
  * Usage:
  * 1. Create an uploader: mds_uploader_t *uploader = mds_uploader_create();
  * 2. Set it on the session: mds_set_upload_callback(session, mds_uploader_callback, uploader);
- * 3. Process streams: mds_stream_process(session, &config, timeout);
- * 4. Destroy when done: mds_uploader_destroy(uploader);
+ * 3. After mds_read_device_config(), optionally pre-warm the connection:
+ *    mds_uploader_prewarm(uploader, config.data_uri);
+ * 4. Process streams: mds_stream_process(session, &config, timeout);
+ * 5. With retries or a spool, call mds_uploader_poll() periodically from
+ *    another thread
+ * 6. Destroy when done: mds_uploader_destroy(uploader);
+ *
+ * The uploader keeps its connection to the chunks endpoint alive between
+ * uploads (TCP keepalive, TLS session resumption), so only the first
+ * request to a host pays for the TCP and TLS handshakes.
+ *
+ * To survive network outages, attach a disk spool (see mds_spool.h) with
+ * mds_uploader_set_spool(). Chunks that fail with a transient error are then
+ * persisted instead of lost, and replayed in order once uploads succeed again.
+ *
+ * Transient failures can also be retried in memory with jittered exponential
+ * backoff, see mds_uploader_set_retry_policy(). Retries are scheduled on a
+ * timer and performed by mds_uploader_poll(), so they never delay the upload
+ * of fresh chunks.
+ *
+ * Thread safety: one uploader can be shared by the sessions of many devices,
+ * each calling mds_uploader_callback() from its own thread. Requests run in
+ * parallel on a pool of libcurl handles that share one connection cache, TLS
+ * session cache and DNS cache; at most mds_uploader_set_max_connections()
+ * requests per host are in flight at once and further callers wait. Set the
+ * retry policy and spool before sharing the uploader, and destroy it only
+ * after all callers have returned. Requires POSIX threads.
  */
 
 #ifndef MEMFAULT_MDS_UPLOAD_H
@@ -22,12 +48,43 @@ extern "C" {
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "memfault_hid/mds_spool.h"
+
+/** Largest per-device history accepted by mds_uploader_set_dedup() */
+#define MDS_DEDUP_MAX_HISTORY       64
+
+/** Devices whose recent chunk fingerprints are remembered */
+#define MDS_DEDUP_MAX_DEVICES       256
 
 /**
  * @brief Opaque handle to an HTTP uploader
  */
 typedef struct mds_uploader mds_uploader_t;
 
+/**
+ * Number of histogram buckets: values 0-3 exactly, then four buckets per
+ * power of two up to 2^32 (about 19% relative error). Larger values land in
+ * the last bucket.
+ */
+#define MDS_HISTOGRAM_BUCKETS 124
+
+/**
+ * @brief Log-bucketed histogram
+ */
+typedef struct {
+    /** Number of samples */
+    uint64_t count;
+
+    /** Sum of all samples */
+    uint64_t sum;
+
+    /** Largest sample */
+    uint64_t max;
+
+    /** Sample counts per bucket */
+    uint64_t buckets[MDS_HISTOGRAM_BUCKETS];
+} mds_histogram_t;
+
 /**
  * @brief Upload statistics
  */
@@ -43,8 +100,88 @@ typedef struct {
 
     /** Last HTTP status code */
     long last_http_status;
+
+    /** Chunks written to the spool instead of being uploaded directly */
+    size_t chunks_spooled;
+
+    /** Spooled chunks uploaded successfully */
+    size_t chunks_drained;
+
+    /** Chunks that could not be written to the spool (lost) */
+    size_t spool_failures;
+
+    /** Upload attempts made by the retry scheduler */
+    size_t retries;
+
+    /** Chunks that failed every attempt allowed by the retry policy */
+    size_t retries_exhausted;
+
+    /** Chunks currently waiting for a retry */
+    size_t retries_pending;
+
+    /** Requests sent with a compressed body */
+    size_t chunks_compressed;
+
+    /** Request body bytes saved by compression */
+    size_t bytes_saved;
+
+    /** Requests delayed by the rate limiter */
+    size_t rate_limited;
+
+    /** Total time requests spent waiting for the rate limiter, in milliseconds */
+    uint64_t rate_limit_delay_ms;
+
+    /** Requests currently waiting for the rate limiter */
+    size_t rate_limit_waiting;
+
+    /** Rate limiter buckets (distinct host and project key pairs) */
+    size_t rate_limit_buckets;
+
+    /** Chunks dropped as byte-identical to a recent chunk from the same device */
+    size_t duplicates_suppressed;
+
+    /** Request latency in microseconds, for requests that got a response */
+    mds_histogram_t latency_us;
+
+    /** TLS handshake time in microseconds, for requests that opened a connection */
+    mds_histogram_t tls_handshake_us;
+
+    /** Request body size in bytes */
+    mds_histogram_t request_bytes;
 } mds_upload_stats_t;
 
+/**
+ * @brief Request body encodings
+ */
+typedef enum {
+    MDS_UPLOAD_ENCODING_NONE = 0,   /**< Send chunks as-is (default) */
+    MDS_UPLOAD_ENCODING_GZIP,       /**< Content-Encoding: gzip */
+    MDS_UPLOAD_ENCODING_DEFLATE,    /**< Content-Encoding: deflate (zlib format) */
+} mds_upload_encoding_t;
+
+/**
+ * @brief Retry policy for transient upload failures
+ *
+ * A failure is transient if it is a network error or HTTP 408, 429 or 5xx.
+ * The delay before attempt n+1 is drawn uniformly from
+ * [d/2, d] with d = min(base_delay_ms * 2^(n-1), max_delay_ms). A Retry-After
+ * header in the response overrides the computed delay, but is also capped
+ * at max_delay_ms.
+ */
+typedef struct {
+    /** Upload attempts per chunk, including the first (1 disables retries) */
+    uint32_t max_attempts;
+
+    /** Backoff before the first retry */
+    uint32_t base_delay_ms;
+
+    /** Upper bound for the backoff, including server Retry-After delays */
+    uint32_t max_delay_ms;
+
+    /** Maximum chunks held in memory waiting for a retry */
+    size_t max_pending;
+} mds_retry_policy_t;
+
 /**
  * @brief Create an HTTP uploader
  *
@@ -80,6 +217,19 @@ void mds_uploader_destroy(mds_uploader_t *uploader);
  * @param chunk_len Length of chunk data
  * @param user_data Must be a mds_uploader_t* instance
  *
+ * With a spool attached, a chunk that fails with a network error, HTTP 408,
+ * 429 or 5xx is spooled and 0 is returned once it is on disk. While the spool
+ * is not empty, new chunks are queued behind it to keep upload order;
+ * mds_uploader_poll() uploads them.
+ *
+ * Without a spool but with a retry policy, a transiently failed chunk is
+ * copied and queued for an in-memory retry and 0 is returned. With both, the
+ * chunk is spooled instead (it is never acknowledged before it is on disk)
+ * and the policy's backoff paces attempts to drain the spool.
+ * Retried chunks may reach the backend after chunks uploaded later. Due
+ * retries are performed by mds_uploader_poll(), never by this callback, a
+ * bounded batch per call, round-robin across devices (data URIs).
+ *
  * @return 0 on success, negative error code on failure
  */
 int mds_uploader_callback(const char *uri,
@@ -88,6 +238,82 @@ int mds_uploader_callback(const char *uri,
                           size_t chunk_len,
                           void *user_data);
 
+/**
+ * @brief Pre-warm a connection to the upload host
+ *
+ * Performs a HEAD request to the URI so DNS resolution, TCP connect and the
+ * TLS handshake are done before the first chunk arrives. The connection is
+ * kept in the uploader's pool and reused by the next upload to the same host.
+ * Call this as soon as mds_read_device_config() returns.
+ *
+ * @param uploader Uploader handle
+ * @param uri Data URI from the device configuration
+ *
+ * @return 0 on success, negative error code otherwise (uploads still work)
+ */
+int mds_uploader_prewarm(mds_uploader_t *uploader,
+                         const char *uri);
+
+/**
+ * @brief Attach a disk spool for failed uploads
+ *
+ * The spool is not owned by the uploader; close it after destroying the
+ * uploader. Pass NULL to detach.
+ *
+ * @param uploader Uploader handle
+ * @param spool Spool handle from mds_spool_open(), or NULL
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_uploader_set_spool(mds_uploader_t *uploader,
+                           mds_spool_t *spool);
+
+/**
+ * @brief Upload chunks from the attached spool
+ *
+ * Uploads spooled chunks oldest first and stops at the first failure.
+ * mds_uploader_poll() drains in bounded batches; call this to flush the
+ * whole spool at once, for example at startup.
+ *
+ * @param uploader Uploader handle
+ * @param max_chunks Maximum number of chunks to upload (0 for no limit)
+ *
+ * @return Number of chunks uploaded, or negative error code
+ *         -EIO if the first spooled chunk could not be uploaded
+ */
+int mds_uploader_drain_spool(mds_uploader_t *uploader,
+                             size_t max_chunks);
+
+/**
+ * @brief Set the retry policy for transient failures
+ *
+ * Retries are disabled by default (max_attempts of 1). With a spool
+ * attached, failed chunks wait in the spool instead of memory and are kept
+ * until uploaded; only the backoff delays apply.
+ *
+ * @param uploader Uploader handle
+ * @param policy Retry policy to copy
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_uploader_set_retry_policy(mds_uploader_t *uploader,
+                                  const mds_retry_policy_t *policy);
+
+/**
+ * @brief Perform retries that are due and drain the spool
+ *
+ * Performs a bounded batch of due retries. With a spool attached it also
+ * uploads a bounded batch of spooled chunks, oldest first, backing off
+ * after a failure (by the retry policy if set, otherwise a few seconds). Call it periodically (for example once a
+ * second) from a thread other than the session threads; it performs
+ * uploads and may block for their duration.
+ *
+ * @param uploader Uploader handle
+ *
+ * @return Number of retries and spooled chunks uploaded, or negative error code
+ */
+int mds_uploader_poll(mds_uploader_t *uploader);
+
 /**
  * @brief Get upload statistics
  *
@@ -101,6 +327,50 @@ int mds_uploader_callback(const char *uri,
 int mds_uploader_get_stats(mds_uploader_t *uploader,
                            mds_upload_stats_t *stats);
 
+/**
+ * @brief Get upload statistics and reset them
+ *
+ * Histogram fields are read and cleared with atomic exchanges, so samples
+ * recorded concurrently are reported either in this snapshot or the next
+ * one, never lost or counted twice.
+ *
+ * @param uploader Uploader handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_uploader_take_stats(mds_uploader_t *uploader,
+                            mds_upload_stats_t *stats);
+
+/**
+ * @brief Get a percentile from a histogram
+ *
+ * The result is the upper bound of the bucket holding the sample at the
+ * given rank, capped at the largest sample.
+ *
+ * @param histogram Histogram from mds_upload_stats_t
+ * @param quantile Rank between 0.0 and 1.0 (e.g. 0.99 for p99)
+ *
+ * @return Percentile value, or 0 if the histogram is empty
+ */
+uint64_t mds_histogram_percentile(const mds_histogram_t *histogram,
+                                  double quantile);
+
+/** @brief Median of a histogram */
+static inline uint64_t mds_histogram_p50(const mds_histogram_t *histogram) {
+    return mds_histogram_percentile(histogram, 0.50);
+}
+
+/** @brief 99th percentile of a histogram */
+static inline uint64_t mds_histogram_p99(const mds_histogram_t *histogram) {
+    return mds_histogram_percentile(histogram, 0.99);
+}
+
+/** @brief 99.9th percentile of a histogram */
+static inline uint64_t mds_histogram_p999(const mds_histogram_t *histogram) {
+    return mds_histogram_percentile(histogram, 0.999);
+}
+
 /**
  * @brief Reset upload statistics
  *
@@ -125,6 +395,82 @@ int mds_uploader_reset_stats(mds_uploader_t *uploader);
 int mds_uploader_set_timeout(mds_uploader_t *uploader,
                              long timeout_ms);
 
+/**
+ * @brief Set the maximum number of concurrent connections per host
+ *
+ * Limits how many requests to the same scheme, host and port run in
+ * parallel, which bounds the connections opened to the chunks endpoint.
+ * Default is 4.
+ *
+ * @param uploader Uploader handle
+ * @param max_per_host Maximum concurrent requests per host (at least 1)
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_uploader_set_max_connections(mds_uploader_t *uploader,
+                                     size_t max_per_host);
+
+/**
+ * @brief Compress request bodies
+ *
+ * Chunks of at least min_size bytes are compressed with zlib and sent with
+ * the matching Content-Encoding header. If compression does not make a chunk
+ * smaller it is sent as-is. Only enable this for endpoints that accept
+ * compressed request bodies.
+ *
+ * @param uploader Uploader handle
+ * @param encoding Encoding to use (MDS_UPLOAD_ENCODING_NONE to disable)
+ * @param level zlib compression level, 1 (fastest) to 9 (smallest)
+ * @param min_size Smallest chunk worth compressing, in bytes
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_uploader_set_compression(mds_uploader_t *uploader,
+                                 mds_upload_encoding_t encoding,
+                                 int level,
+                                 size_t min_size);
+
+/**
+ * @brief Limit the request rate per host and project key
+ *
+ * Each pair of host and authorization header (project key) gets a token
+ * bucket that refills at rate requests per second and holds up to burst
+ * tokens. A request that finds its bucket empty waits for its turn instead
+ * of failing, so a burst of devices draining at once is spread out rather
+ * than tripping server-side rate limits. Waiting requests are served in
+ * arrival order.
+ *
+ * @param uploader Uploader handle
+ * @param rate Requests per second per bucket (0 to disable, the default)
+ * @param burst Bucket size, at least 1 when rate is non-zero
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_uploader_set_rate_limit(mds_uploader_t *uploader,
+                                double rate,
+                                uint32_t burst);
+
+/**
+ * @brief Drop chunks that repeat a recently uploaded one
+ *
+ * When the device's packetizer aborts a message (disconnect, busy timeout)
+ * it re-sends the whole message, so the gateway can reassemble chunks it
+ * already uploaded. With deduplication enabled the uploader remembers a
+ * 64-bit fingerprint of the last history chunks accepted for each device
+ * (identified by its data URI) and drops byte-identical repeats, returning
+ * 0 from mds_uploader_callback() as if they had been uploaded.
+ *
+ * Up to MDS_DEDUP_MAX_DEVICES devices are tracked; the least recently seen
+ * is forgotten first. Changing the history clears all fingerprints.
+ *
+ * @param uploader Uploader handle
+ * @param history Fingerprints kept per device (0 to disable, the default;
+ *                at most MDS_DEDUP_MAX_HISTORY)
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_uploader_set_dedup(mds_uploader_t *uploader, size_t history);
+
 /**
  * @brief Enable/disable verbose output
  *
@@ -6,6 +6,20 @@
  * using custom report types. It supports multiple platforms (Windows, macOS, Linux)
  * and can be integrated into applications that use other HID reports for additional
  * device functionality.
+ *
+ * Thread safety:
+ * - memfault_hid_init() and memfault_hid_exit() are reference counted and may
+ *   be called from any thread; each component pairs its own calls.
+ * - memfault_hid_enumerate(), memfault_hid_enumerate_compact(),
+ *   memfault_hid_open(), memfault_hid_open_path() and memfault_hid_close()
+ *   may be called concurrently from any thread. Their hidapi calls are
+ *   serialized internally, since not every hidapi backend allows otherwise.
+ * - memfault_hid_free_device_list(), memfault_hid_free_device_entries(),
+ *   memfault_hid_error_string() and memfault_hid_version_string() touch no
+ *   shared state.
+ * - All other calls take a device handle. Different handles may be used in
+ *   parallel, but each handle from one thread at a time; close it only once
+ *   no other call on it is running.
  */
 
 #ifndef MEMFAULT_HID_H
@@ -24,9 +38,17 @@ extern "C" {
 #define MEMFAULT_HID_VERSION_MINOR 0
 #define MEMFAULT_HID_VERSION_PATCH 0
 
-/* Maximum report size (typical HID limit is 64 bytes for low-speed devices) */
+/*
+ * Default report size (typical HID limit is 64 bytes for low-speed devices).
+ * Buffers are sized from the device's report descriptor at open, and never
+ * smaller than this; see memfault_hid_get_max_report_size().
+ */
 #define MEMFAULT_HID_MAX_REPORT_SIZE 64
 
+/* Top-level usage of the MDS HID interface (vendor-defined page) */
+#define MEMFAULT_HID_MDS_USAGE_PAGE 0xFF00
+#define MEMFAULT_HID_MDS_USAGE      0x01
+
 /**
  * @brief Error codes
  */
@@ -79,6 +101,34 @@ typedef struct {
     int interface_number;            /* USB interface number */
 } memfault_hid_device_info_t;
 
+/**
+ * @brief Compact device information returned by memfault_hid_enumerate_compact()
+ *
+ * Strings point into the same allocation as the entry array. Missing
+ * strings are empty, never NULL.
+ */
+typedef struct {
+    const char *path;                /* Platform-specific device path */
+    const wchar_t *serial_number;    /* Serial number (wide string) */
+    const wchar_t *manufacturer;     /* Manufacturer string (wide string) */
+    const wchar_t *product;          /* Product string (wide string) */
+    uint16_t vendor_id;              /* USB Vendor ID */
+    uint16_t product_id;             /* USB Product ID */
+    uint16_t release_number;         /* Device release number */
+    uint16_t usage_page;             /* HID usage page */
+    uint16_t usage;                  /* HID usage */
+    int interface_number;            /* USB interface number */
+} memfault_hid_device_entry_t;
+
+/**
+ * @brief Flags for memfault_hid_enumerate_compact()
+ */
+typedef enum {
+    /* Only interfaces whose top-level usage is
+       MEMFAULT_HID_MDS_USAGE_PAGE / MEMFAULT_HID_MDS_USAGE */
+    MEMFAULT_HID_ENUMERATE_MDS_ONLY = 0x01
+} memfault_hid_enumerate_flags_t;
+
 /**
  * @brief Report filter configuration
  *
@@ -91,6 +141,31 @@ typedef struct {
     bool filter_enabled;             /* Enable/disable filtering */
 } memfault_hid_report_filter_t;
 
+/**
+ * @brief Borrowed view of a received input report
+ *
+ * Points into a receive buffer owned by the device handle. The view stays
+ * valid until the next read on the same device or memfault_hid_close().
+ */
+typedef struct {
+    uint8_t report_id;               /* Report ID */
+    const uint8_t *data;             /* Report data (excluding Report ID) */
+    size_t length;                   /* Length of report data */
+} memfault_hid_report_view_t;
+
+/**
+ * @brief Raw input report slot for memfault_hid_read_reports()
+ *
+ * The caller provides the storage: set buffer and size before reading. Size
+ * buffers for the largest input report plus the Report ID, from
+ * memfault_hid_get_max_report_size(), so no report is truncated.
+ */
+typedef struct {
+    uint8_t *buffer;                 /* Receives the Report ID, then report data */
+    size_t size;                     /* Size of buffer */
+    size_t length;                   /* Bytes read into buffer, including Report ID */
+} memfault_hid_raw_report_t;
+
 /* ============================================================================
  * Library Initialization
  * ========================================================================== */
@@ -98,7 +173,8 @@ typedef struct {
 /**
  * @brief Initialize the HID library
  *
- * This function must be called before any other library functions.
+ * This function must be called before any other library functions. Each
+ * call takes a reference; hidapi is initialized by the first. Thread-safe.
  *
  * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
  */
@@ -107,7 +183,9 @@ int memfault_hid_init(void);
 /**
  * @brief Cleanup and shutdown the HID library
  *
- * This function should be called when done using the library.
+ * Drops a reference taken by memfault_hid_init(); hidapi is shut down when
+ * the last one is dropped, so one component exiting doesn't affect others.
+ * Extra calls are ignored. Thread-safe.
  *
  * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
  */
@@ -141,6 +219,42 @@ int memfault_hid_enumerate(uint16_t vendor_id,
  */
 void memfault_hid_free_device_list(memfault_hid_device_info_t *devices);
 
+/**
+ * @brief Enumerate HID devices into a compact, single-allocation list
+ *
+ * Like memfault_hid_enumerate(), but entries hold only pointers to strings
+ * packed into one arena after the array, so an entry costs its actual
+ * string lengths instead of about 1.8 KB. With MEMFAULT_HID_ENUMERATE_MDS_ONLY
+ * the other interfaces of composite devices (keyboards, mice, ...) are
+ * skipped before anything is allocated.
+ *
+ * @param vendor_id USB Vendor ID (0x0000 for all vendors)
+ * @param product_id USB Product ID (0x0000 for all products)
+ * @param flags Bitwise OR of memfault_hid_enumerate_flags_t
+ * @param devices Pointer to receive the entry array (NULL if none found)
+ * @param num_devices Pointer to receive the number of entries
+ *
+ * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
+ *
+ * @note Usage filtering relies on the platform backend reporting the usage
+ *       page, which the hidraw, Windows and macOS backends do (the libusb
+ *       backend only with hidapi 0.10 or newer).
+ * @note The caller must free the returned list using
+ *       memfault_hid_free_device_entries()
+ */
+int memfault_hid_enumerate_compact(uint16_t vendor_id,
+                                   uint16_t product_id,
+                                   uint32_t flags,
+                                   memfault_hid_device_entry_t **devices,
+                                   size_t *num_devices);
+
+/**
+ * @brief Free device list returned by memfault_hid_enumerate_compact()
+ *
+ * @param devices Device list to free
+ */
+void memfault_hid_free_device_entries(memfault_hid_device_entry_t *devices);
+
 /* ============================================================================
  * Device Management
  * ========================================================================== */
@@ -175,6 +289,9 @@ int memfault_hid_open(uint16_t vendor_id,
 /**
  * @brief Close a HID device
  *
+ * Waits for a write still in flight after a MEMFAULT_HID_ERROR_TIMEOUT
+ * (hidraw gives up on an unresponsive USB device after a few seconds).
+ *
  * @param device Device handle to close
  */
 void memfault_hid_close(memfault_hid_device_t *device);
@@ -190,6 +307,38 @@ void memfault_hid_close(memfault_hid_device_t *device);
 int memfault_hid_get_device_info(memfault_hid_device_t *device,
                                   memfault_hid_device_info_t *info);
 
+/**
+ * @brief Get the size of a report declared by the device
+ *
+ * Sizes come from the report descriptor, read when the device is opened.
+ *
+ * @param device Device handle
+ * @param type Report type
+ * @param report_id Report ID (0 if the device doesn't use Report IDs)
+ *
+ * @return Report size in bytes (excluding Report ID) on success,
+ *         MEMFAULT_HID_ERROR_NOT_FOUND if the report is not declared,
+ *         MEMFAULT_HID_ERROR_NOT_SUPPORTED if the descriptor is unavailable
+ */
+int memfault_hid_get_report_size(memfault_hid_device_t *device,
+                                 memfault_hid_report_type_t type,
+                                 uint8_t report_id);
+
+/**
+ * @brief Get the largest report size of a type
+ *
+ * A buffer of this size plus one byte for the Report ID holds any report of
+ * the type. Never less than MEMFAULT_HID_MAX_REPORT_SIZE.
+ *
+ * @param device Device handle
+ * @param type Report type
+ *
+ * @return Largest report size in bytes (excluding Report ID) on success,
+ *         negative error code otherwise
+ */
+int memfault_hid_get_max_report_size(memfault_hid_device_t *device,
+                                     memfault_hid_report_type_t type);
+
 /* ============================================================================
  * Report Filtering
  * ========================================================================== */
@@ -211,6 +360,10 @@ int memfault_hid_set_report_filter(memfault_hid_device_t *device,
 /**
  * @brief Get current report filter configuration
  *
+ * The returned report_ids points into the device handle and stays valid
+ * until the filter is changed or the device is closed. Duplicate IDs given
+ * to memfault_hid_set_report_filter() are listed once.
+ *
  * @param device Device handle
  * @param filter Pointer to receive filter configuration
  *
@@ -226,13 +379,25 @@ int memfault_hid_get_report_filter(memfault_hid_device_t *device,
 /**
  * @brief Write an output or feature report to the device
  *
+ * hidapi writes block until the device takes the report. With a timeout
+ * the write runs on a per-device writer thread, started on first use, and
+ * the call returns MEMFAULT_HID_ERROR_TIMEOUT if the device doesn't take
+ * the report in time. The report then stays queued and is written if the
+ * device recovers. Later writes wait for it within their own timeout.
+ * With 0 the report is handed to the writer thread and the call returns
+ * without waiting for the device; the outcome of that write is not
+ * reported. With -1 the write runs on the calling thread.
+ *
  * @param device Device handle
  * @param report_id Report ID (or 0 if device doesn't use Report IDs)
  * @param data Report data (excluding Report ID)
  * @param length Length of data
- * @param timeout_ms Timeout in milliseconds (0 for non-blocking, -1 for infinite)
+ * @param timeout_ms Timeout in milliseconds (0 = don't wait, -1 for infinite)
  *
- * @return Number of bytes written on success, negative error code otherwise
+ * @return Number of bytes written (or handed off, with timeout 0) on success,
+ *         negative error code otherwise (MEMFAULT_HID_ERROR_TIMEOUT if the
+ *         device didn't take the report, or with timeout 0 if an earlier
+ *         write is still pending)
  */
 int memfault_hid_write_report(memfault_hid_device_t *device,
                                uint8_t report_id,
@@ -257,13 +422,79 @@ int memfault_hid_read_report(memfault_hid_device_t *device,
                               size_t length,
                               int timeout_ms);
 
+/**
+ * @brief Read an input report into a caller buffer without copying
+ *
+ * Unlike memfault_hid_read_report(), the report is read straight into the
+ * caller's buffer, Report ID included: buffer[0] is the Report ID and the
+ * report data follows.
+ *
+ * @param device Device handle
+ * @param buffer Buffer to receive the report (largest input report + 1 bytes,
+ *               see memfault_hid_get_max_report_size())
+ * @param length Length of buffer
+ * @param timeout_ms Timeout in milliseconds (0 for non-blocking, -1 for infinite)
+ *
+ * @return Number of bytes read including the Report ID, negative error code otherwise
+ */
+int memfault_hid_read_raw_report(memfault_hid_device_t *device,
+                                 uint8_t *buffer,
+                                 size_t length,
+                                 int timeout_ms);
+
+/**
+ * @brief Read an input report into the device's receive buffer
+ *
+ * Zero-copy counterpart of memfault_hid_read_report(): the report is read
+ * into a buffer owned by the device handle and returned as a view, which
+ * stays valid until the next read on this device. Pass the view's data to
+ * mds_parse_stream_packet_view() to parse a stream report without copying.
+ *
+ * @param device Device handle
+ * @param view Pointer to receive the report view
+ * @param timeout_ms Timeout in milliseconds (0 for non-blocking, -1 for infinite)
+ *
+ * @return Number of data bytes read (excluding Report ID) on success,
+ *         negative error code otherwise
+ */
+int memfault_hid_read_report_view(memfault_hid_device_t *device,
+                                  memfault_hid_report_view_t *view,
+                                  int timeout_ms);
+
+/**
+ * @brief Read every immediately available input report in one call
+ *
+ * Waits up to timeout_ms for the first report, then drains reports already
+ * queued by the OS without blocking, up to max_reports. Meant for emptying
+ * the backlog of Stream Data reports that builds up after a reconnect.
+ * Reports rejected by the report filter are consumed and skipped.
+ *
+ * Every slot must have a buffer of at least
+ * memfault_hid_get_max_report_size(device, MEMFAULT_HID_REPORT_TYPE_INPUT) + 1
+ * bytes; smaller buffers are rejected rather than risk truncating a report.
+ *
+ * @param device Device handle
+ * @param reports Slots to receive the reports, in arrival order; only length
+ *                is written
+ * @param max_reports Number of entries in reports
+ * @param timeout_ms Timeout for the first report in milliseconds
+ *                   (0 for non-blocking, -1 for infinite)
+ *
+ * @return Number of reports read (at least 1) on success, negative error
+ *         code otherwise (MEMFAULT_HID_ERROR_TIMEOUT if none arrived)
+ */
+int memfault_hid_read_reports(memfault_hid_device_t *device,
+                              memfault_hid_raw_report_t *reports,
+                              size_t max_reports,
+                              int timeout_ms);
+
 /**
  * @brief Get a feature report from the device
  *
  * @param device Device handle
  * @param report_id Report ID to get
  * @param data Buffer to receive report data
- * @param length Length of buffer
+ * @param length Length of buffer (data beyond it is discarded)
  *
  * @return Number of bytes received on success, negative error code otherwise
  */
@@ -0,0 +1,547 @@
+/**
+ * @file mds_config_cache.c
+ * @brief Device config cache with optional file persistence
+ */
+
+#include "memfault_hid/mds_config_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* File layout: header, then records back to back */
+#define CACHE_MAGIC             0x4353444Du  /* "MDSC" */
+#define CACHE_VERSION           1
+#define CACHE_MAX_FILE_SIZE     (16u * 1024 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t crc;           /* CRC32 of the records */
+} cache_file_header_t;
+
+/* Record header, followed by serial, device ID, URI and auth (no NULs) */
+typedef struct {
+    uint16_t serial_len;
+    uint16_t release_number;
+    uint32_t supported_features;
+    uint16_t device_id_len;
+    uint16_t uri_len;
+    uint16_t auth_len;
+    uint16_t reserved;
+} cache_file_record_t;
+
+/* Cached configuration, most recently used first */
+typedef struct mds_config_cache_entry {
+    struct mds_config_cache_entry *next;
+    uint16_t release_number;
+    mds_device_config_t config;
+    char serial_number[];
+} mds_config_cache_entry_t;
+
+struct mds_config_cache {
+    pthread_mutex_t lock;
+    pthread_mutex_t save_lock;      /* Orders file writes, which share one temp file */
+    char *path;
+    size_t max_entries;
+    size_t count;
+    bool dirty;
+    mds_config_cache_entry_t *entries;
+    mds_config_cache_stats_t stats;
+};
+
+/* ============================================================================
+ * Helpers
+ * ========================================================================== */
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static bool config_equal(const mds_device_config_t *a, const mds_device_config_t *b) {
+    return a->supported_features == b->supported_features &&
+           strcmp(a->device_identifier, b->device_identifier) == 0 &&
+           strcmp(a->data_uri, b->data_uri) == 0 &&
+           strcmp(a->authorization, b->authorization) == 0;
+}
+
+/* Find an entry by serial number; called with lock held */
+static mds_config_cache_entry_t **entry_find(mds_config_cache_t *cache, const char *serial_number) {
+    mds_config_cache_entry_t **link = &cache->entries;
+    while (*link != NULL && strcmp((*link)->serial_number, serial_number) != 0) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/* Insert or replace an entry at the front, evicting the oldest; called with lock held */
+static int entry_put(mds_config_cache_t *cache, const char *serial_number,
+                     uint16_t release_number, const mds_device_config_t *config) {
+    mds_config_cache_entry_t **link = entry_find(cache, serial_number);
+    mds_config_cache_entry_t *entry = *link;
+
+    if (entry != NULL) {
+        *link = entry->next;
+    } else {
+        size_t serial_len = strlen(serial_number) + 1;
+        entry = malloc(sizeof(*entry) + serial_len);
+        if (entry == NULL) {
+            return -ENOMEM;
+        }
+        memcpy(entry->serial_number, serial_number, serial_len);
+        cache->count++;
+    }
+
+    entry->release_number = release_number;
+    entry->config = *config;
+    entry->next = cache->entries;
+    cache->entries = entry;
+    cache->dirty = true;
+
+    /* Drop the least recently used entries over the limit */
+    if (cache->count > cache->max_entries) {
+        mds_config_cache_entry_t **tail = &cache->entries;
+        for (size_t i = 0; i < cache->max_entries; i++) {
+            tail = &(*tail)->next;
+        }
+        while (*tail != NULL) {
+            mds_config_cache_entry_t *old = *tail;
+            *tail = old->next;
+            free(old);
+            cache->count--;
+        }
+    }
+
+    return 0;
+}
+
+/* ============================================================================
+ * Persistence
+ * ========================================================================== */
+
+/* Copy a length-prefixed string out of a record into a NUL-terminated field */
+static bool load_string(const uint8_t **pos, const uint8_t *end, size_t len,
+                        char *out, size_t out_size) {
+    if (len >= out_size || len > (size_t)(end - *pos)) {
+        return false;
+    }
+    memcpy(out, *pos, len);
+    out[len] = '\0';
+    *pos += len;
+    return true;
+}
+
+/* Load entries from the cache file; a bad file is ignored */
+static void cache_load(mds_config_cache_t *cache) {
+    FILE *file = fopen(cache->path, "rb");
+    if (file == NULL) {
+        return;
+    }
+
+    uint8_t *data = NULL;
+    cache_file_header_t header;
+    long size = -1;
+
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+
+    if (size < (long)sizeof(header) || size > (long)CACHE_MAX_FILE_SIZE ||
+        fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+        fclose(file);
+        return;
+    }
+
+    size_t data_len = (size_t)size - sizeof(header);
+    data = malloc(data_len > 0 ? data_len : 1);
+    if (data == NULL || fread(data, 1, data_len, file) != data_len ||
+        crc32_update(0, data, data_len) != header.crc) {
+        free(data);
+        fclose(file);
+        return;
+    }
+    fclose(file);
+
+    /* The file lists most recently used first; insert in reverse */
+    const uint8_t *pos = data;
+    const uint8_t *end = data + data_len;
+    mds_config_cache_entry_t *loaded = NULL;
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        cache_file_record_t record;
+        if ((size_t)(end - pos) < sizeof(record)) {
+            break;
+        }
+        memcpy(&record, pos, sizeof(record));
+        pos += sizeof(record);
+
+        if (record.serial_len == 0 || record.serial_len > (size_t)(end - pos)) {
+            break;
+        }
+
+        mds_config_cache_entry_t *entry = malloc(sizeof(*entry) + record.serial_len + 1);
+        if (entry == NULL) {
+            break;
+        }
+        memcpy(entry->serial_number, pos, record.serial_len);
+        entry->serial_number[record.serial_len] = '\0';
+        pos += record.serial_len;
+
+        entry->release_number = record.release_number;
+        entry->config.supported_features = record.supported_features;
+
+        if (!load_string(&pos, end, record.device_id_len, entry->config.device_identifier,
+                         sizeof(entry->config.device_identifier)) ||
+            !load_string(&pos, end, record.uri_len, entry->config.data_uri,
+                         sizeof(entry->config.data_uri)) ||
+            !load_string(&pos, end, record.auth_len, entry->config.authorization,
+                         sizeof(entry->config.authorization))) {
+            free(entry);
+            break;
+        }
+
+        entry->next = loaded;
+        loaded = entry;
+    }
+
+    free(data);
+
+    while (loaded != NULL) {
+        mds_config_cache_entry_t *entry = loaded;
+        loaded = entry->next;
+        entry_put(cache, entry->serial_number, entry->release_number, &entry->config);
+        free(entry);
+    }
+
+    cache->dirty = false;
+}
+
+/* Serialize all entries; called with lock held */
+static uint8_t *cache_serialize(mds_config_cache_t *cache, size_t *len) {
+    size_t data_len = 0;
+    for (mds_config_cache_entry_t *e = cache->entries; e != NULL; e = e->next) {
+        data_len += sizeof(cache_file_record_t) + strlen(e->serial_number) +
+                    strlen(e->config.device_identifier) + strlen(e->config.data_uri) +
+                    strlen(e->config.authorization);
+    }
+
+    uint8_t *buffer = malloc(sizeof(cache_file_header_t) + data_len);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    uint8_t *pos = buffer + sizeof(cache_file_header_t);
+    for (mds_config_cache_entry_t *e = cache->entries; e != NULL; e = e->next) {
+        cache_file_record_t record = {
+            .serial_len = (uint16_t)strlen(e->serial_number),
+            .release_number = e->release_number,
+            .supported_features = e->config.supported_features,
+            .device_id_len = (uint16_t)strlen(e->config.device_identifier),
+            .uri_len = (uint16_t)strlen(e->config.data_uri),
+            .auth_len = (uint16_t)strlen(e->config.authorization),
+        };
+        memcpy(pos, &record, sizeof(record));
+        pos += sizeof(record);
+        memcpy(pos, e->serial_number, record.serial_len);
+        pos += record.serial_len;
+        memcpy(pos, e->config.device_identifier, record.device_id_len);
+        pos += record.device_id_len;
+        memcpy(pos, e->config.data_uri, record.uri_len);
+        pos += record.uri_len;
+        memcpy(pos, e->config.authorization, record.auth_len);
+        pos += record.auth_len;
+    }
+
+    cache_file_header_t header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .count = (uint32_t)cache->count,
+        .crc = crc32_update(0, buffer + sizeof(header), data_len),
+    };
+    memcpy(buffer, &header, sizeof(header));
+
+    *len = sizeof(header) + data_len;
+    return buffer;
+}
+
+/* Write a file through a temporary so readers never see a partial one */
+static int write_file_atomic(const char *path, const uint8_t *data, size_t len) {
+    size_t tmp_len = strlen(path) + sizeof(".tmp");
+    char *tmp_path = malloc(tmp_len);
+    if (tmp_path == NULL) {
+        return -ENOMEM;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+    int ret = 0;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        ret = -errno;
+        free(tmp_path);
+        return ret;
+    }
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ret = -errno;
+            break;
+        }
+        written += (size_t)n;
+    }
+
+    if (ret == 0 && fsync(fd) != 0) {
+        ret = -errno;
+    }
+    close(fd);
+
+    if (ret == 0 && rename(tmp_path, path) != 0) {
+        ret = -errno;
+    }
+    if (ret != 0) {
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    return ret;
+}
+
+/* ============================================================================
+ * Cache Management
+ * ========================================================================== */
+
+int mds_config_cache_open(const char *path, size_t max_entries, mds_config_cache_t **cache) {
+    if (max_entries == 0 || cache == NULL) {
+        return -EINVAL;
+    }
+
+    mds_config_cache_t *c = calloc(1, sizeof(mds_config_cache_t));
+    if (c == NULL) {
+        return -ENOMEM;
+    }
+
+    if (path != NULL) {
+        c->path = strdup(path);
+        if (c->path == NULL) {
+            free(c);
+            return -ENOMEM;
+        }
+    }
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_mutex_init(&c->save_lock, NULL);
+    c->max_entries = max_entries;
+
+    if (c->path != NULL) {
+        cache_load(c);
+    }
+
+    *cache = c;
+    return 0;
+}
+
+void mds_config_cache_close(mds_config_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    if (cache->dirty) {
+        mds_config_cache_save(cache);
+    }
+
+    while (cache->entries != NULL) {
+        mds_config_cache_entry_t *entry = cache->entries;
+        cache->entries = entry->next;
+        free(entry);
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    pthread_mutex_destroy(&cache->save_lock);
+    free(cache->path);
+    free(cache);
+}
+
+int mds_config_cache_save(mds_config_cache_t *cache) {
+    if (cache == NULL) {
+        return -EINVAL;
+    }
+
+    if (cache->path == NULL) {
+        return 0;
+    }
+
+    /* The snapshot taken last is written last */
+    pthread_mutex_lock(&cache->save_lock);
+
+    pthread_mutex_lock(&cache->lock);
+    size_t len;
+    uint8_t *data = cache_serialize(cache, &len);
+    bool was_dirty = cache->dirty;
+    cache->dirty = false;
+    pthread_mutex_unlock(&cache->lock);
+
+    int ret = -ENOMEM;
+    if (data != NULL) {
+        ret = write_file_atomic(cache->path, data, len);
+        free(data);
+    }
+
+    if (ret != 0 && was_dirty) {
+        pthread_mutex_lock(&cache->lock);
+        cache->dirty = true;
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    pthread_mutex_unlock(&cache->save_lock);
+    return ret;
+}
+
+/* ============================================================================
+ * Lookup and Store
+ * ========================================================================== */
+
+int mds_config_cache_lookup(mds_config_cache_t *cache,
+                            const char *serial_number,
+                            uint16_t release_number,
+                            mds_device_config_t *config) {
+    if (cache == NULL || serial_number == NULL || config == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    mds_config_cache_entry_t **link = entry_find(cache, serial_number);
+    mds_config_cache_entry_t *entry = *link;
+    int ret = -ENOENT;
+
+    if (entry != NULL && entry->release_number == release_number) {
+        /* Move to front */
+        *link = entry->next;
+        entry->next = cache->entries;
+        cache->entries = entry;
+
+        *config = entry->config;
+        cache->stats.hits++;
+        ret = 0;
+    } else {
+        cache->stats.misses++;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+int mds_config_cache_store(mds_config_cache_t *cache,
+                           const char *serial_number,
+                           uint16_t release_number,
+                           const mds_device_config_t *config) {
+    if (cache == NULL || serial_number == NULL || *serial_number == '\0' || config == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    int ret = entry_put(cache, serial_number, release_number, config);
+    pthread_mutex_unlock(&cache->lock);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Stores only happen on misses and config changes, so save right away */
+    return mds_config_cache_save(cache);
+}
+
+int mds_config_cache_read_config(mds_config_cache_t *cache,
+                                 mds_session_t *session,
+                                 const char *serial_number,
+                                 uint16_t release_number,
+                                 mds_device_config_t *config,
+                                 bool *cached) {
+    if (cache == NULL || session == NULL || serial_number == NULL || config == NULL) {
+        return -EINVAL;
+    }
+
+    if (cached != NULL) {
+        *cached = false;
+    }
+
+    /* Without a serial number the device can't be told apart from others */
+    if (*serial_number == '\0') {
+        return mds_read_device_config(session, config);
+    }
+
+    if (mds_config_cache_lookup(cache, serial_number, release_number, config) == 0) {
+        if (cached != NULL) {
+            *cached = true;
+        }
+        return 0;
+    }
+
+    int ret = mds_read_device_config(session, config);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mds_config_cache_store(cache, serial_number, release_number, config);
+    return 0;
+}
+
+int mds_config_cache_verify(mds_config_cache_t *cache,
+                            mds_session_t *session,
+                            const char *serial_number,
+                            uint16_t release_number,
+                            mds_device_config_t *config) {
+    if (cache == NULL || session == NULL || serial_number == NULL || config == NULL) {
+        return -EINVAL;
+    }
+
+    mds_device_config_t fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    int ret = mds_read_device_config(session, &fresh);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (config_equal(&fresh, config)) {
+        return 0;
+    }
+
+    if (*serial_number != '\0') {
+        mds_config_cache_store(cache, serial_number, release_number, &fresh);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.verify_mismatches++;
+    pthread_mutex_unlock(&cache->lock);
+
+    *config = fresh;
+    return 1;
+}
+
+int mds_config_cache_get_stats(mds_config_cache_t *cache, mds_config_cache_stats_t *stats) {
+    if (cache == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    stats->entries = cache->count;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
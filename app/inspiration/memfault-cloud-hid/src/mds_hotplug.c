@@ -0,0 +1,561 @@
+/**
+ * @file mds_hotplug.c
+ * @brief udev-based hotplug monitor for MDS devices
+ */
+
+#include "memfault_hid/mds_hotplug.h"
+#include "memfault_hid_descriptor.h"
+#include <errno.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include <libudev.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Largest report descriptor read from sysfs */
+#define HOTPLUG_MAX_DESCRIPTOR_SIZE 4096
+
+/* Delay before checking a cached config, to keep it off the bring-up path */
+#define HOTPLUG_VERIFY_DELAY_MS     2000
+
+/* MDS-capable node we reported as added, so its removal can be reported */
+typedef struct mds_hotplug_node {
+    struct mds_hotplug_node *next;
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint16_t release_number;
+    char *serial_number;
+    uint64_t verify_at_ms;          /* When to check config, 0 if not pending */
+    mds_device_config_t config;     /* Cached config handed out at bring-up */
+    char path[];
+} mds_hotplug_node_t;
+
+struct mds_hotplug {
+    struct udev *udev;
+    struct udev_monitor *monitor;
+    mds_hotplug_config_t config;
+    mds_hotplug_callback_t callback;
+    void *user_data;
+    bool scan_pending;              /* enumerate_existing not yet done */
+    mds_hotplug_node_t *nodes;
+};
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* ============================================================================
+ * Device Matching
+ * ========================================================================== */
+
+/* Check whether any top-level collection uses the MDS vendor usage */
+static bool descriptor_is_mds(const uint8_t *desc, size_t len) {
+    uint32_t usage_page = 0;
+    uint32_t usage = 0;
+    bool have_usage = false;
+    int depth = 0;
+    size_t pos = 0;
+    memfault_hid_item_t item;
+
+    while (memfault_hid_descriptor_next(desc, len, &pos, &item)) {
+        if (item.type == MEMFAULT_HID_ITEM_GLOBAL && item.tag == 0x0) {
+            usage_page = item.value;                    /* Usage Page */
+        } else if (item.type == MEMFAULT_HID_ITEM_LOCAL && item.tag == 0x0 && !have_usage) {
+            /* Usage; a 4-byte usage carries its own page */
+            usage = (item.size == 4) ? item.value : ((usage_page << 16) | (item.value & 0xFFFF));
+            have_usage = true;
+        } else if (item.type == MEMFAULT_HID_ITEM_MAIN) {
+            if (item.tag == 0xA) {
+                /* Collection */
+                if (depth == 0 && have_usage &&
+                    usage == (((uint32_t)MEMFAULT_HID_MDS_USAGE_PAGE << 16) | MEMFAULT_HID_MDS_USAGE)) {
+                    return true;
+                }
+                depth++;
+            } else if (item.tag == 0xC && depth > 0) {
+                depth--;                                /* End Collection */
+            }
+            have_usage = false;                         /* Local items end here */
+        }
+    }
+
+    return false;
+}
+
+/* Read the HID parent's report descriptor from sysfs and check it */
+static bool hid_device_is_mds(struct udev_device *hid) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/report_descriptor", udev_device_get_syspath(hid));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    uint8_t *desc = malloc(HOTPLUG_MAX_DESCRIPTOR_SIZE);
+    bool is_mds = false;
+    if (desc != NULL) {
+        size_t len = fread(desc, 1, HOTPLUG_MAX_DESCRIPTOR_SIZE, file);
+        is_mds = descriptor_is_mds(desc, len);
+        free(desc);
+    }
+
+    fclose(file);
+    return is_mds;
+}
+
+/* ============================================================================
+ * Node Tracking
+ * ========================================================================== */
+
+static mds_hotplug_node_t **node_find(mds_hotplug_t *hotplug, const char *path) {
+    mds_hotplug_node_t **link = &hotplug->nodes;
+    while (*link != NULL && strcmp((*link)->path, path) != 0) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void node_free(mds_hotplug_node_t *node) {
+    free(node->serial_number);
+    free(node);
+}
+
+/* ============================================================================
+ * Session Bring-up
+ * ========================================================================== */
+
+/* Drop stream flags the device does not advertise */
+static uint8_t negotiate_stream_mode(uint8_t mode, uint32_t features) {
+    if (mode == MDS_STREAM_MODE_DISABLED) {
+        mode = MDS_STREAM_MODE_ENABLED;
+    }
+    if (!(features & MDS_FEATURE_RELIABLE_STREAM)) {
+        mode &= (uint8_t)~MDS_STREAM_MODE_FLAG_RELIABLE;
+    }
+    if (!(features & MDS_FEATURE_EXTENDED_SEQUENCE)) {
+        mode &= (uint8_t)~MDS_STREAM_MODE_FLAG_EXTENDED_SEQ;
+    }
+    if (!(features & MDS_FEATURE_COMPRESSED_STREAM)) {
+        mode &= (uint8_t)~MDS_STREAM_MODE_FLAG_COMPRESSED;
+    }
+    return mode;
+}
+
+/* Open the device, read its config and enable streaming */
+static int session_bring_up(mds_hotplug_t *hotplug, mds_hotplug_event_t *event,
+                            mds_device_config_t *config) {
+    memfault_hid_device_t *device;
+    int ret = memfault_hid_open_path(event->path, &device);
+    if (ret != MEMFAULT_HID_SUCCESS) {
+        return ret;
+    }
+
+    mds_session_t *session;
+    ret = mds_session_create(device, &session);
+    if (ret < 0) {
+        memfault_hid_close(device);
+        return ret;
+    }
+
+    /* With a cache hit the only transfer is the stream mode Set_Report */
+    if (hotplug->config.config_cache != NULL) {
+        ret = mds_config_cache_read_config(hotplug->config.config_cache, session,
+                                           event->serial_number, event->release_number,
+                                           config, &event->config_cached);
+    } else {
+        ret = mds_read_device_config(session, config);
+    }
+    if (ret == 0) {
+        event->stream_mode = negotiate_stream_mode(hotplug->config.stream_mode,
+                                                   config->supported_features);
+        ret = mds_stream_set_mode(session, event->stream_mode);
+    }
+
+    if (ret < 0) {
+        mds_session_destroy(session);
+        memfault_hid_close(device);
+        return ret;
+    }
+
+    event->device = device;
+    event->session = session;
+    event->config = config;
+    return 0;
+}
+
+/* ============================================================================
+ * Event Handling
+ * ========================================================================== */
+
+static bool handle_add(mds_hotplug_t *hotplug, struct udev_device *dev) {
+    const char *path = udev_device_get_devnode(dev);
+    if (path == NULL || *node_find(hotplug, path) != NULL) {
+        return false;
+    }
+
+    struct udev_device *hid = udev_device_get_parent_with_subsystem_devtype(dev, "hid", NULL);
+    if (hid == NULL) {
+        return false;
+    }
+
+    /* HID_ID is "bus:vendor:product" in hex */
+    const char *hid_id = udev_device_get_property_value(hid, "HID_ID");
+    unsigned int bus, vendor_id, product_id;
+    if (hid_id == NULL || sscanf(hid_id, "%x:%x:%x", &bus, &vendor_id, &product_id) != 3) {
+        return false;
+    }
+
+    if ((hotplug->config.vendor_id != 0 && vendor_id != hotplug->config.vendor_id) ||
+        (hotplug->config.product_id != 0 && product_id != hotplug->config.product_id)) {
+        return false;
+    }
+
+    if (!hid_device_is_mds(hid)) {
+        return false;
+    }
+
+    const char *serial = udev_device_get_property_value(hid, "HID_UNIQ");
+
+    /* bcdDevice lives on the USB device; other buses leave it 0 */
+    unsigned int release_number = 0;
+    struct udev_device *usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+    const char *bcd = usb != NULL ? udev_device_get_sysattr_value(usb, "bcdDevice") : NULL;
+    if (bcd != NULL && sscanf(bcd, "%x", &release_number) != 1) {
+        release_number = 0;
+    }
+
+    size_t path_len = strlen(path) + 1;
+
+    mds_hotplug_node_t *node = malloc(sizeof(*node) + path_len);
+    if (node == NULL) {
+        return false;
+    }
+    memcpy(node->path, path, path_len);
+    node->vendor_id = (uint16_t)vendor_id;
+    node->product_id = (uint16_t)product_id;
+    node->release_number = (uint16_t)release_number;
+    node->serial_number = strdup(serial != NULL ? serial : "");
+    if (node->serial_number == NULL) {
+        free(node);
+        return false;
+    }
+    node->verify_at_ms = 0;
+    node->next = hotplug->nodes;
+    hotplug->nodes = node;
+
+    mds_hotplug_event_t event = {
+        .type = MDS_HOTPLUG_EVENT_ADDED,
+        .path = node->path,
+        .vendor_id = node->vendor_id,
+        .product_id = node->product_id,
+        .release_number = node->release_number,
+        .serial_number = node->serial_number,
+    };
+    mds_device_config_t config;
+
+    if (hotplug->config.auto_session) {
+        event.error = session_bring_up(hotplug, &event, &config);
+        if (event.error == 0 && event.config_cached) {
+            node->config = config;
+            node->verify_at_ms = monotonic_ms() + HOTPLUG_VERIFY_DELAY_MS;
+        }
+    }
+
+    hotplug->callback(&event, hotplug->user_data);
+    return true;
+}
+
+static bool handle_remove(mds_hotplug_t *hotplug, struct udev_device *dev) {
+    const char *path = udev_device_get_devnode(dev);
+    if (path == NULL) {
+        return false;
+    }
+
+    /* Only nodes reported as added; sysfs is already gone */
+    mds_hotplug_node_t **link = node_find(hotplug, path);
+    mds_hotplug_node_t *node = *link;
+    if (node == NULL) {
+        return false;
+    }
+    *link = node->next;
+
+    mds_hotplug_event_t event = {
+        .type = MDS_HOTPLUG_EVENT_REMOVED,
+        .path = node->path,
+        .vendor_id = node->vendor_id,
+        .product_id = node->product_id,
+        .release_number = node->release_number,
+        .serial_number = node->serial_number,
+    };
+
+    hotplug->callback(&event, hotplug->user_data);
+    node_free(node);
+    return true;
+}
+
+/*
+ * Check a node's cached config against the device through a second handle;
+ * the session streaming from the first is owned by the callback. Reports
+ * MDS_HOTPLUG_EVENT_CONFIG_CHANGED if it differs.
+ */
+static bool verify_cached_config(mds_hotplug_t *hotplug, mds_hotplug_node_t *node) {
+    node->verify_at_ms = 0;
+
+    memfault_hid_device_t *device;
+    if (memfault_hid_open_path(node->path, &device) != MEMFAULT_HID_SUCCESS) {
+        return false;
+    }
+
+    mds_session_t *session;
+    int ret = mds_session_create(device, &session);
+    if (ret == 0) {
+        ret = mds_config_cache_verify(hotplug->config.config_cache, session,
+                                      node->serial_number, node->release_number,
+                                      &node->config);
+        mds_session_destroy(session);
+    }
+    memfault_hid_close(device);
+
+    if (ret != 1) {
+        return false;
+    }
+
+    mds_hotplug_event_t event = {
+        .type = MDS_HOTPLUG_EVENT_CONFIG_CHANGED,
+        .path = node->path,
+        .vendor_id = node->vendor_id,
+        .product_id = node->product_id,
+        .release_number = node->release_number,
+        .serial_number = node->serial_number,
+        .config = &node->config,
+    };
+
+    hotplug->callback(&event, hotplug->user_data);
+    return true;
+}
+
+/* Earliest pending config check, 0 if none */
+static uint64_t next_verify_ms(mds_hotplug_t *hotplug) {
+    uint64_t next = 0;
+    for (mds_hotplug_node_t *node = hotplug->nodes; node != NULL; node = node->next) {
+        if (node->verify_at_ms != 0 && (next == 0 || node->verify_at_ms < next)) {
+            next = node->verify_at_ms;
+        }
+    }
+    return next;
+}
+
+/* Run the config checks that are due */
+static int verify_due(mds_hotplug_t *hotplug) {
+    uint64_t now = monotonic_ms();
+    int delivered = 0;
+
+    /* Rescan after each check; the callback may have changed the list */
+    bool found = true;
+    while (found) {
+        found = false;
+        for (mds_hotplug_node_t *node = hotplug->nodes; node != NULL; node = node->next) {
+            if (node->verify_at_ms != 0 && node->verify_at_ms <= now) {
+                delivered += verify_cached_config(hotplug, node) ? 1 : 0;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    return delivered;
+}
+
+/* Report hidraw nodes present before the monitor started */
+static int scan_existing(mds_hotplug_t *hotplug) {
+    struct udev_enumerate *enumerate = udev_enumerate_new(hotplug->udev);
+    if (enumerate == NULL) {
+        return -ENOMEM;
+    }
+
+    udev_enumerate_add_match_subsystem(enumerate, "hidraw");
+    udev_enumerate_scan_devices(enumerate);
+
+    int delivered = 0;
+    struct udev_list_entry *entry;
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+        struct udev_device *dev =
+            udev_device_new_from_syspath(hotplug->udev, udev_list_entry_get_name(entry));
+        if (dev == NULL) {
+            continue;
+        }
+        if (handle_add(hotplug, dev)) {
+            delivered++;
+        }
+        udev_device_unref(dev);
+    }
+
+    udev_enumerate_unref(enumerate);
+    return delivered;
+}
+
+/* ============================================================================
+ * Monitor Management
+ * ========================================================================== */
+
+int mds_hotplug_create(const mds_hotplug_config_t *config,
+                       mds_hotplug_callback_t callback,
+                       void *user_data,
+                       mds_hotplug_t **hotplug) {
+    if (config == NULL || callback == NULL || hotplug == NULL) {
+        return -EINVAL;
+    }
+
+    mds_hotplug_t *h = calloc(1, sizeof(mds_hotplug_t));
+    if (h == NULL) {
+        return -ENOMEM;
+    }
+
+    h->config = *config;
+    h->callback = callback;
+    h->user_data = user_data;
+    h->scan_pending = config->enumerate_existing;
+
+    h->udev = udev_new();
+    if (h->udev == NULL) {
+        free(h);
+        return -ENOMEM;
+    }
+
+    /* Events from udev rather than the kernel, so device nodes exist with their final permissions */
+    h->monitor = udev_monitor_new_from_netlink(h->udev, "udev");
+    if (h->monitor == NULL ||
+        udev_monitor_filter_add_match_subsystem_devtype(h->monitor, "hidraw", NULL) < 0 ||
+        udev_monitor_enable_receiving(h->monitor) < 0) {
+        if (h->monitor != NULL) {
+            udev_monitor_unref(h->monitor);
+        }
+        udev_unref(h->udev);
+        free(h);
+        return -EIO;
+    }
+
+    *hotplug = h;
+    return 0;
+}
+
+void mds_hotplug_destroy(mds_hotplug_t *hotplug) {
+    if (hotplug == NULL) {
+        return;
+    }
+
+    while (hotplug->nodes != NULL) {
+        mds_hotplug_node_t *node = hotplug->nodes;
+        hotplug->nodes = node->next;
+        node_free(node);
+    }
+
+    udev_monitor_unref(hotplug->monitor);
+    udev_unref(hotplug->udev);
+    free(hotplug);
+}
+
+int mds_hotplug_get_fd(mds_hotplug_t *hotplug) {
+    if (hotplug == NULL) {
+        return -EINVAL;
+    }
+
+    return udev_monitor_get_fd(hotplug->monitor);
+}
+
+int mds_hotplug_process(mds_hotplug_t *hotplug, int timeout_ms) {
+    if (hotplug == NULL) {
+        return -EINVAL;
+    }
+
+    int delivered = 0;
+
+    /* The monitor is already receiving, so nothing added meanwhile is missed */
+    if (hotplug->scan_pending) {
+        hotplug->scan_pending = false;
+        int ret = scan_existing(hotplug);
+        if (ret < 0) {
+            return ret;
+        }
+        delivered += ret;
+        if (delivered > 0) {
+            timeout_ms = 0;
+        }
+    }
+
+    /* Wake up in time for the next config check */
+    uint64_t verify_at = next_verify_ms(hotplug);
+    if (verify_at != 0) {
+        uint64_t now = monotonic_ms();
+        uint64_t wait = verify_at > now ? verify_at - now : 0;
+        if (timeout_ms < 0 || wait < (uint64_t)timeout_ms) {
+            timeout_ms = wait < INT_MAX ? (int)wait : INT_MAX;
+        }
+    }
+
+    struct pollfd pfd = {
+        .fd = udev_monitor_get_fd(hotplug->monitor),
+        .events = POLLIN,
+    };
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0 && errno != EINTR) {
+        return -errno;
+    }
+
+    if (ret > 0) {
+        /* The monitor socket is non-blocking; drain everything queued */
+        struct udev_device *dev;
+        while ((dev = udev_monitor_receive_device(hotplug->monitor)) != NULL) {
+            const char *action = udev_device_get_action(dev);
+
+            if (action != NULL && strcmp(action, "add") == 0) {
+                delivered += handle_add(hotplug, dev) ? 1 : 0;
+            } else if (action != NULL && strcmp(action, "remove") == 0) {
+                delivered += handle_remove(hotplug, dev) ? 1 : 0;
+            }
+
+            udev_device_unref(dev);
+        }
+    }
+
+    delivered += verify_due(hotplug);
+    return delivered;
+}
+
+#else /* !__linux__ */
+
+int mds_hotplug_create(const mds_hotplug_config_t *config,
+                       mds_hotplug_callback_t callback,
+                       void *user_data,
+                       mds_hotplug_t **hotplug) {
+    (void)config;
+    (void)callback;
+    (void)user_data;
+    (void)hotplug;
+    return -ENOTSUP;
+}
+
+void mds_hotplug_destroy(mds_hotplug_t *hotplug) {
+    (void)hotplug;
+}
+
+int mds_hotplug_get_fd(mds_hotplug_t *hotplug) {
+    (void)hotplug;
+    return -ENOTSUP;
+}
+
+int mds_hotplug_process(mds_hotplug_t *hotplug, int timeout_ms) {
+    (void)hotplug;
+    (void)timeout_ms;
+    return -ENOTSUP;
+}
+
+#endif /* __linux__ */
@@ -5,19 +5,60 @@
 
 #include "memfault_hid/mds_protocol.h"
 #include "memfault_hid/memfault_hid.h"
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+/* Receive slabs: enough for a full reliable window plus the report being read */
+#define MDS_RX_SLAB_COUNT   (MDS_RELIABLE_WINDOW_SIZE + 1)
+
+/* Received packet whose payload still lives in its receive slab */
+typedef struct {
+    uint16_t sequence;
+    uint8_t slab;
+    const uint8_t *data;
+    size_t data_len;
+} mds_rx_packet_t;
+
 /* MDS Session structure */
 struct mds_session {
     memfault_hid_device_t *device;
-    uint8_t last_sequence;
+    uint16_t last_sequence;
+    uint16_t sequence_mask;         /* MDS_SEQUENCE_MASK or MDS_SEQUENCE_MASK_EXT */
+    bool sequence_valid;            /* last_sequence holds a received packet */
     bool streaming_enabled;
+    bool mode_unknown;              /* A stream mode write timed out, see mds_stream_set_mode() */
+
+    /* Reception statistics */
+    mds_session_stats_t stats;
+    mds_log_callback_t log_callback;
+    void *log_user_data;
 
     /* Chunk upload */
     mds_chunk_upload_callback_t upload_callback;
     void *upload_user_data;
+
+    /* Reliable mode receive window */
+    bool reliable;
+    uint8_t ack_sequence;           /* Highest contiguous sequence delivered */
+    uint32_t rx_received;           /* Bit i: (ack_sequence + 1 + i) buffered */
+    uint8_t rx_unacked;             /* Packets delivered since the last ack */
+    mds_rx_packet_t rx_window[MDS_RELIABLE_WINDOW_SIZE];
+
+    /* Reports are read into these and parsed in place, see stream_receive() */
+    uint8_t *rx_slabs;              /* MDS_RX_SLAB_COUNT * rx_slab_size */
+    size_t rx_slab_size;            /* Report ID + largest input report */
+    uint32_t rx_slabs_free;         /* Bit i: slab i is free */
+    uint8_t *rx_batch;              /* MDS_STREAM_READ_MAX_PACKETS * rx_slab_size, on demand */
+
+    /* Compressed mode frame reassembly */
+    bool compressed;
+    bool frame_active;              /* Collecting slices since a frame start */
+    size_t frame_len;
+    uint8_t *frame;                 /* MDS_FRAME_HEADER_LEN + MDS_MAX_FRAME_LEN */
+    uint8_t *frame_chunk;           /* MDS_MAX_FRAME_LEN */
 };
 
 /* ============================================================================
@@ -36,36 +77,166 @@ int mds_session_create(memfault_hid_device_t *device, mds_session_t **session) {
         return -ENOMEM;
     }
 
+    /* Size slabs for the device's largest input report */
+    int max_input = (device != NULL)
+                        ? memfault_hid_get_max_report_size(device, MEMFAULT_HID_REPORT_TYPE_INPUT)
+                        : MEMFAULT_HID_MAX_REPORT_SIZE;
+    if (max_input < MEMFAULT_HID_MAX_REPORT_SIZE) {
+        max_input = MEMFAULT_HID_MAX_REPORT_SIZE;
+    }
+    s->rx_slab_size = (size_t)max_input + 1;
+
+    s->rx_slabs = malloc(MDS_RX_SLAB_COUNT * s->rx_slab_size);
+    if (s->rx_slabs == NULL) {
+        free(s);
+        return -ENOMEM;
+    }
+    s->rx_slabs_free = (1u << MDS_RX_SLAB_COUNT) - 1;
+
     s->device = device;
     s->last_sequence = MDS_SEQUENCE_MAX;  /* Initialize to max so first packet (0) is valid */
+    s->sequence_mask = MDS_SEQUENCE_MASK;
     s->streaming_enabled = false;
+    s->ack_sequence = MDS_SEQUENCE_MAX;
 
     *session = s;
     return 0;
 }
 
+static void session_log(mds_session_t *session, const char *fmt, ...) {
+    if (session->log_callback == NULL) {
+        return;
+    }
+
+    char message[128];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    session->log_callback(message, session->log_user_data);
+}
+
+static void session_drop_frame(mds_session_t *session, const char *reason) {
+    if (!session->frame_active) {
+        return;
+    }
+
+    session->frame_active = false;
+    session->stats.frames_dropped++;
+    session_log(session, "Dropped compressed frame: %s", reason);
+}
+
+/* Account a received sequence number and make it the last one */
+static void session_record_sequence(mds_session_t *session, uint16_t sequence) {
+    bool extended = (session->sequence_mask == MDS_SEQUENCE_MASK_EXT);
+
+    session->stats.packets_received++;
+
+    if (session->sequence_valid) {
+        uint16_t lost = mds_count_lost_packets(session->last_sequence, sequence, extended);
+
+        if (lost == session->sequence_mask) {
+            /* Same sequence number as the previous packet */
+            session->stats.duplicates++;
+            session_log(session, "Duplicate packet, sequence %u", sequence);
+            session_drop_frame(session, "duplicate packet");
+        } else if (lost > 0) {
+            session->stats.sequence_gaps++;
+            session->stats.packets_lost += lost;
+            session_log(session, "Sequence gap: expected %u, got %u (%u lost)",
+                        (session->last_sequence + 1) & session->sequence_mask,
+                        sequence, lost);
+            session_drop_frame(session, "sequence gap");
+        }
+    }
+
+    session->last_sequence = sequence & session->sequence_mask;
+    session->sequence_valid = true;
+}
+
 void mds_session_destroy(mds_session_t *session) {
     if (session == NULL) {
         return;
     }
 
-    /* Disable streaming if enabled */
-    if (session->streaming_enabled) {
+    /* Disable streaming if enabled, or if it may have been */
+    if (session->streaming_enabled || session->mode_unknown) {
         mds_stream_disable(session);
     }
 
+    free(session->frame);
+    free(session->frame_chunk);
+    free(session->rx_slabs);
+    free(session->rx_batch);
     free(session);
 }
 
+int mds_session_get_stats(mds_session_t *session, mds_session_stats_t *stats) {
+    if (session == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    *stats = session->stats;
+    return 0;
+}
+
+int mds_session_reset_stats(mds_session_t *session) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    memset(&session->stats, 0, sizeof(session->stats));
+    return 0;
+}
+
+int mds_set_log_callback(mds_session_t *session,
+                         mds_log_callback_t callback,
+                         void *user_data) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    session->log_callback = callback;
+    session->log_user_data = user_data;
+
+    return 0;
+}
+
 /* ============================================================================
  * Device Configuration
  * ========================================================================== */
 
+/* Read and parse the device config report */
+static int get_device_config_report(mds_session_t *session, size_t data_len,
+                                    mds_device_config_t *config) {
+    uint8_t *data = malloc(data_len);
+    if (data == NULL) {
+        return -ENOMEM;
+    }
+
+    int ret = memfault_hid_get_feature_report(session->device, MDS_REPORT_ID_DEVICE_CONFIG,
+                                              data, data_len);
+    if (ret >= 0) {
+        ret = mds_parse_device_config(data, (size_t)ret, config);
+    }
+
+    free(data);
+    return ret;
+}
+
 int mds_read_device_config(mds_session_t *session, mds_device_config_t *config) {
     if (session == NULL || config == NULL) {
         return -EINVAL;
     }
 
+    /* The descriptor declares the config report: a single transfer */
+    int size = memfault_hid_get_report_size(session->device, MEMFAULT_HID_REPORT_TYPE_FEATURE,
+                                            MDS_REPORT_ID_DEVICE_CONFIG);
+    if (size > 0) {
+        return get_device_config_report(session, (size_t)size, config);
+    }
+
     int ret;
 
     /* Read supported features */
@@ -74,6 +245,16 @@ int mds_read_device_config(mds_session_t *session, mds_device_config_t *config)
         return ret;
     }
 
+    /*
+     * Without a descriptor, trust the feature bit. The report may not fit
+     * the default-sized buffer; fall back to the individual reports then.
+     */
+    if ((config->supported_features & MDS_FEATURE_DEVICE_CONFIG_REPORT) &&
+        size != MEMFAULT_HID_ERROR_NOT_FOUND &&
+        get_device_config_report(session, MDS_DEVICE_CONFIG_REPORT_LEN, config) == 0) {
+        return 0;
+    }
+
     /* Read device identifier */
     ret = mds_get_device_identifier(session, config->device_identifier,
                                      sizeof(config->device_identifier));
@@ -115,21 +296,39 @@ int mds_get_supported_features(mds_session_t *session, uint32_t *features) {
     return mds_parse_supported_features(data, ret, features);
 }
 
+/*
+ * Read a string feature report into a buffer sized from the device's report
+ * descriptor (default_len if it is unavailable) and parse it into out.
+ */
+static int get_string_feature(mds_session_t *session, uint8_t report_id, size_t default_len,
+                              int (*parse)(const uint8_t *, size_t, char *, size_t),
+                              char *out, size_t max_len) {
+    int size = memfault_hid_get_report_size(session->device, MEMFAULT_HID_REPORT_TYPE_FEATURE,
+                                            report_id);
+    size_t data_len = (size > 0) ? (size_t)size : default_len;
+
+    uint8_t *data = malloc(data_len);
+    if (data == NULL) {
+        return -ENOMEM;
+    }
+
+    int ret = memfault_hid_get_feature_report(session->device, report_id, data, data_len);
+    if (ret >= 0) {
+        /* Use the buffer-based parser */
+        ret = parse(data, (size_t)ret, out, max_len);
+    }
+
+    free(data);
+    return ret;
+}
+
 int mds_get_device_identifier(mds_session_t *session, char *device_id, size_t max_len) {
     if (session == NULL || device_id == NULL || max_len == 0) {
         return -EINVAL;
     }
 
-    uint8_t data[MDS_MAX_DEVICE_ID_LEN];
-    int ret = memfault_hid_get_feature_report(session->device,
-                                               MDS_REPORT_ID_DEVICE_IDENTIFIER,
-                                               data, sizeof(data));
-    if (ret < 0) {
-        return ret;
-    }
-
-    /* Use the buffer-based parser */
-    return mds_parse_device_identifier(data, ret, device_id, max_len);
+    return get_string_feature(session, MDS_REPORT_ID_DEVICE_IDENTIFIER, MDS_MAX_DEVICE_ID_LEN,
+                              mds_parse_device_identifier, device_id, max_len);
 }
 
 int mds_get_data_uri(mds_session_t *session, char *uri, size_t max_len) {
@@ -137,16 +336,8 @@ int mds_get_data_uri(mds_session_t *session, char *uri, size_t max_len) {
         return -EINVAL;
     }
 
-    uint8_t data[MDS_MAX_URI_LEN];
-    int ret = memfault_hid_get_feature_report(session->device,
-                                               MDS_REPORT_ID_DATA_URI,
-                                               data, sizeof(data));
-    if (ret < 0) {
-        return ret;
-    }
-
-    /* Use the buffer-based parser */
-    return mds_parse_data_uri(data, ret, uri, max_len);
+    return get_string_feature(session, MDS_REPORT_ID_DATA_URI, MDS_MAX_URI_LEN,
+                              mds_parse_data_uri, uri, max_len);
 }
 
 int mds_get_authorization(mds_session_t *session, char *auth, size_t max_len) {
@@ -154,16 +345,8 @@ int mds_get_authorization(mds_session_t *session, char *auth, size_t max_len) {
         return -EINVAL;
     }
 
-    uint8_t data[MDS_MAX_AUTH_LEN];
-    int ret = memfault_hid_get_feature_report(session->device,
-                                               MDS_REPORT_ID_AUTHORIZATION,
-                                               data, sizeof(data));
-    if (ret < 0) {
-        return ret;
-    }
-
-    /* Use the buffer-based parser */
-    return mds_parse_authorization(data, ret, auth, max_len);
+    return get_string_feature(session, MDS_REPORT_ID_AUTHORIZATION, MDS_MAX_AUTH_LEN,
+                              mds_parse_authorization, auth, max_len);
 }
 
 /* ============================================================================
@@ -171,48 +354,93 @@ int mds_get_authorization(mds_session_t *session, char *auth, size_t max_len) {
  * ========================================================================== */
 
 int mds_stream_enable(mds_session_t *session) {
+    return mds_stream_set_mode(session, MDS_STREAM_MODE_ENABLED);
+}
+
+int mds_stream_disable(mds_session_t *session) {
+    return mds_stream_set_mode(session, MDS_STREAM_MODE_DISABLED);
+}
+
+int mds_stream_set_mode(mds_session_t *session, uint8_t mode) {
     if (session == NULL) {
         return -EINVAL;
     }
 
     /* Use the buffer-based builder */
     uint8_t buffer[1];
-    int bytes = mds_build_stream_control(true, buffer, sizeof(buffer));
+    int bytes = mds_build_stream_control_mode(mode, buffer, sizeof(buffer));
     if (bytes < 0) {
         return bytes;
     }
 
+    bool compressed = (mode & MDS_STREAM_MODE_FLAG_COMPRESSED) != 0;
+    if (compressed && session->frame == NULL) {
+        session->frame = malloc(MDS_FRAME_HEADER_LEN + MDS_MAX_FRAME_LEN);
+        session->frame_chunk = malloc(MDS_MAX_FRAME_LEN);
+        if (session->frame == NULL || session->frame_chunk == NULL) {
+            free(session->frame);
+            free(session->frame_chunk);
+            session->frame = NULL;
+            session->frame_chunk = NULL;
+            return -ENOMEM;
+        }
+    }
+
     int ret = memfault_hid_write_report(session->device,
                                          MDS_REPORT_ID_STREAM_CONTROL,
                                          buffer, bytes, 1000);
+    if (ret == MEMFAULT_HID_ERROR_TIMEOUT) {
+        /* The report stays queued; the device may still switch to the new mode */
+        session->mode_unknown = true;
+        session->streaming_enabled = false;
+        return ret;
+    }
     if (ret < 0) {
         return ret;
     }
 
-    session->streaming_enabled = true;
+    session->mode_unknown = false;
+    session->streaming_enabled = (mode != MDS_STREAM_MODE_DISABLED);
+
+    /* Compressed streams always use the extended header */
+    session->compressed = compressed;
+    session->frame_active = false;
+    session->frame_len = 0;
+
+    /* Device restarts reliable and extended streams at sequence 0 */
+    session->sequence_mask =
+        (mode & (MDS_STREAM_MODE_FLAG_EXTENDED_SEQ | MDS_STREAM_MODE_FLAG_COMPRESSED)) ?
+        MDS_SEQUENCE_MASK_EXT : MDS_SEQUENCE_MASK;
+    session->last_sequence = session->sequence_mask;
+    session->sequence_valid = false;
+    session->reliable = (mode & MDS_STREAM_MODE_FLAG_RELIABLE) != 0;
+    session->ack_sequence = MDS_SEQUENCE_MAX;
+    session->rx_received = 0;
+    session->rx_unacked = 0;
+    session->rx_slabs_free = (1u << MDS_RX_SLAB_COUNT) - 1;
     return 0;
 }
 
-int mds_stream_disable(mds_session_t *session) {
+int mds_stream_send_ack(mds_session_t *session) {
     if (session == NULL) {
         return -EINVAL;
     }
 
-    /* Use the buffer-based builder */
-    uint8_t buffer[1];
-    int bytes = mds_build_stream_control(false, buffer, sizeof(buffer));
+    uint8_t buffer[MDS_STREAM_ACK_LEN];
+    int bytes = mds_build_stream_ack(session->ack_sequence, session->rx_received,
+                                     buffer, sizeof(buffer));
     if (bytes < 0) {
         return bytes;
     }
 
     int ret = memfault_hid_write_report(session->device,
-                                         MDS_REPORT_ID_STREAM_CONTROL,
+                                         MDS_REPORT_ID_STREAM_ACK,
                                          buffer, bytes, 1000);
     if (ret < 0) {
         return ret;
     }
 
-    session->streaming_enabled = false;
+    session->rx_unacked = 0;
     return 0;
 }
 
@@ -220,36 +448,159 @@ int mds_stream_disable(mds_session_t *session) {
  * Stream Data Reception
  * ========================================================================== */
 
+static void rx_slab_release(mds_session_t *session, uint8_t slab) {
+    session->rx_slabs_free |= 1u << slab;
+}
+
+/*
+ * Parse a raw stream report (Report ID first) in place and account its
+ * sequence number.
+ */
+static int stream_accept(mds_session_t *session, const uint8_t *report, size_t report_len,
+                         mds_stream_packet_view_t *view) {
+    /* Verify this is a stream data report */
+    if (report[0] != MDS_REPORT_ID_STREAM_DATA) {
+        return -EINVAL;  /* Wrong report type */
+    }
+
+    int ret = mds_parse_stream_packet_view(&report[1], report_len - 1,
+                                           session->sequence_mask == MDS_SEQUENCE_MASK_EXT,
+                                           view);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Reliable mode accounts gaps against its receive window instead */
+    if (session->reliable) {
+        session->stats.packets_received++;
+        session->last_sequence = view->sequence;
+        session->sequence_valid = true;
+    } else {
+        session_record_sequence(session, view->sequence);
+    }
+
+    return 0;
+}
+
+/*
+ * Read the next stream report into a free slab and parse it in place. The
+ * packet's data points into the slab, which stays allocated until
+ * rx_slab_release(); the report is never copied on its way to the uploader.
+ */
+static int stream_receive(mds_session_t *session, mds_rx_packet_t *packet, int timeout_ms) {
+    if (session->mode_unknown) {
+        return -ENOTCONN;
+    }
+
+    if (session->rx_slabs_free == 0) {
+        return -ENOBUFS;
+    }
+
+    uint8_t slab = 0;
+    while (!(session->rx_slabs_free & (1u << slab))) {
+        slab++;
+    }
+    uint8_t *report = &session->rx_slabs[slab * session->rx_slab_size];
+
+    int ret = memfault_hid_read_raw_report(session->device, report, session->rx_slab_size,
+                                           timeout_ms);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mds_stream_packet_view_t view;
+    ret = stream_accept(session, report, (size_t)ret, &view);
+    if (ret < 0) {
+        return ret;
+    }
+
+    packet->sequence = view.sequence;
+    packet->data = view.data;
+    packet->data_len = view.data_len;
+    packet->slab = slab;
+    session->rx_slabs_free &= ~(1u << slab);
+
+    return 0;
+}
+
 int mds_stream_read_packet(mds_session_t *session, mds_stream_packet_t *packet,
                            int timeout_ms) {
     if (session == NULL || packet == NULL) {
         return -EINVAL;
     }
 
-    uint8_t report_id;
-    uint8_t data[MDS_MAX_CHUNK_DATA_LEN + 1];  /* +1 for sequence byte */
-
-    int ret = memfault_hid_read_report(session->device, &report_id,
-                                        data, sizeof(data), timeout_ms);
+    mds_rx_packet_t rx;
+    int ret = stream_receive(session, &rx, timeout_ms);
     if (ret < 0) {
         return ret;
     }
 
-    /* Verify this is a stream data report */
-    if (report_id != MDS_REPORT_ID_STREAM_DATA) {
-        return -EINVAL;  /* Wrong report type */
+    packet->sequence = rx.sequence;
+    packet->data_len = rx.data_len;
+    if (packet->data_len > MDS_MAX_CHUNK_DATA_LEN) {
+        packet->data_len = MDS_MAX_CHUNK_DATA_LEN;
     }
+    memcpy(packet->data, rx.data, packet->data_len);
+    rx_slab_release(session, rx.slab);
 
-    /* Use the buffer-based parser */
-    ret = mds_parse_stream_packet(data, ret, packet);
+    return 0;
+}
+
+int mds_stream_read_packets(mds_session_t *session, mds_stream_packet_t *packets,
+                            size_t max_packets, int timeout_ms) {
+    if (session == NULL || packets == NULL || max_packets == 0) {
+        return -EINVAL;
+    }
+
+    if (session->mode_unknown) {
+        return -ENOTCONN;
+    }
+
+    if (max_packets > MDS_STREAM_READ_MAX_PACKETS) {
+        max_packets = MDS_STREAM_READ_MAX_PACKETS;
+    }
+
+    /* Batch buffers are sized like the slabs, for the largest input report */
+    if (session->rx_batch == NULL) {
+        session->rx_batch = malloc(MDS_STREAM_READ_MAX_PACKETS * session->rx_slab_size);
+        if (session->rx_batch == NULL) {
+            return -ENOMEM;
+        }
+    }
+
+    memfault_hid_raw_report_t reports[MDS_STREAM_READ_MAX_PACKETS];
+    for (size_t i = 0; i < max_packets; i++) {
+        reports[i].buffer = &session->rx_batch[i * session->rx_slab_size];
+        reports[i].size = session->rx_slab_size;
+    }
+
+    int ret = memfault_hid_read_reports(session->device, reports, max_packets, timeout_ms);
     if (ret < 0) {
         return ret;
     }
 
-    /* Update last sequence */
-    session->last_sequence = packet->sequence;
+    /* Malformed and foreign reports are skipped, like a failed single read */
+    size_t count = 0;
+    for (int i = 0; i < ret; i++) {
+        mds_stream_packet_view_t view;
+        if (stream_accept(session, reports[i].buffer, reports[i].length, &view) < 0) {
+            continue;
+        }
+
+        packets[count].sequence = view.sequence;
+        packets[count].data_len = view.data_len;
+        if (packets[count].data_len > MDS_MAX_CHUNK_DATA_LEN) {
+            packets[count].data_len = MDS_MAX_CHUNK_DATA_LEN;
+        }
+        memcpy(packets[count].data, view.data, packets[count].data_len);
+        count++;
+    }
 
-    return 0;
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    return (int)count;
 }
 
 /* ============================================================================
@@ -269,40 +620,184 @@ int mds_set_upload_callback(mds_session_t *session,
     return 0;
 }
 
-int mds_stream_process(mds_session_t *session,
+static int upload_chunk(mds_session_t *session,
                         const mds_device_config_t *config,
-                        int timeout_ms) {
-    if (session == NULL || config == NULL) {
+                        const uint8_t *chunk_data,
+                        size_t chunk_len) {
+    if (session->upload_callback == NULL) {
+        return 0;
+    }
+
+    return session->upload_callback(config->data_uri,
+                                    config->authorization,
+                                    chunk_data,
+                                    chunk_len,
+                                    session->upload_user_data);
+}
+
+/* Append a compressed mode packet to the current frame, upload when complete */
+static int frame_append(mds_session_t *session,
+                        const mds_device_config_t *config,
+                        const mds_rx_packet_t *packet) {
+    if (packet->data_len < 1) {
+        return -EINVAL;  /* Need frame control byte */
+    }
+
+    uint8_t ctrl = packet->data[0];
+    const uint8_t *slice = &packet->data[1];
+    size_t slice_len = packet->data_len - 1;
+
+    if (ctrl & MDS_FRAME_CTRL_START) {
+        session_drop_frame(session, "frame restarted");
+        session->frame_active = true;
+        session->frame_len = 0;
+    }
+
+    if (!session->frame_active) {
+        return 0;  /* Rest of a frame we lost the start of */
+    }
+
+    if (slice_len > MDS_FRAME_HEADER_LEN + MDS_MAX_FRAME_LEN - session->frame_len) {
+        session_drop_frame(session, "frame too long");
         return -EINVAL;
     }
 
-    mds_stream_packet_t packet;
-    int ret = mds_stream_read_packet(session, &packet, timeout_ms);
+    memcpy(&session->frame[session->frame_len], slice, slice_len);
+    session->frame_len += slice_len;
+
+    if (!(ctrl & MDS_FRAME_CTRL_END)) {
+        return 0;
+    }
+
+    int chunk_len = mds_decode_frame(session->frame, session->frame_len,
+                                     (ctrl & MDS_FRAME_CTRL_STORED) != 0,
+                                     session->frame_chunk, MDS_MAX_FRAME_LEN);
+    if (chunk_len < 0) {
+        session_drop_frame(session, "corrupt frame");
+        return chunk_len;
+    }
+
+    session->frame_active = false;
+    session->stats.bytes_compressed += session->frame_len - MDS_FRAME_HEADER_LEN;
+    session->stats.bytes_decompressed += (size_t)chunk_len;
+
+    return upload_chunk(session, config, session->frame_chunk, (size_t)chunk_len);
+}
+
+/* Upload a received packet straight from its slab, then free the slab */
+static int upload_packet(mds_session_t *session,
+                         const mds_device_config_t *config,
+                         const mds_rx_packet_t *packet) {
+    int ret;
+
+    if (session->compressed) {
+        ret = frame_append(session, config, packet);
+    } else {
+        ret = upload_chunk(session, config, packet->data, packet->data_len);
+    }
+
+    rx_slab_release(session, packet->slab);
+    return ret;
+}
+
+static int stream_process_reliable(mds_session_t *session,
+                                   const mds_device_config_t *config,
+                                   int timeout_ms) {
+    mds_rx_packet_t packet;
+    int ret = stream_receive(session, &packet, timeout_ms);
     if (ret < 0) {
+        /* Idle stream: report what we have so the device can free its window */
+        if (session->rx_unacked > 0 || session->rx_received != 0) {
+            mds_stream_send_ack(session);
+        }
         return ret;
     }
 
-    /* Validate sequence if we have a previous sequence */
-    if (session->last_sequence != MDS_SEQUENCE_MAX) {
-        if (!mds_validate_sequence(session->last_sequence, packet.sequence)) {
-            /* Log warning but continue - sequence validation is not critical */
-            /* Note: Actual logging would require a logging callback or printf */
+    uint8_t offset = (packet.sequence - session->ack_sequence - 1) & MDS_SEQUENCE_MASK;
+
+    if (offset >= MDS_RELIABLE_WINDOW_SIZE) {
+        /* Already delivered - our ack was lost, repeat it */
+        rx_slab_release(session, packet.slab);
+        session->stats.duplicates++;
+        session_log(session, "Duplicate packet, sequence %u", packet.sequence);
+        return mds_stream_send_ack(session);
+    }
+
+    if (session->rx_received & (1u << offset)) {
+        rx_slab_release(session, packet.slab);
+        session->stats.duplicates++;
+        session_log(session, "Duplicate packet, sequence %u", packet.sequence);
+        return 0;  /* Duplicate of a buffered packet */
+    }
+
+    /* Offset just past the newest packet buffered so far */
+    uint8_t next_offset = 0;
+    for (uint32_t pending = session->rx_received; pending != 0; pending >>= 1) {
+        next_offset++;
+    }
+
+    if (offset > next_offset) {
+        session->stats.sequence_gaps++;
+        session->stats.packets_lost += offset - next_offset;
+        session_log(session, "Sequence gap before %u (%u missing), requesting retransmit",
+                    packet.sequence, offset - next_offset);
+    } else if (offset < next_offset) {
+        session->stats.packets_recovered++;
+    }
+
+    session->rx_window[packet.sequence & (MDS_RELIABLE_WINDOW_SIZE - 1)] = packet;
+    session->rx_received |= 1u << offset;
+
+    bool gap = (offset != 0);
+    int upload_ret = 0;
+
+    /* Deliver everything that is now contiguous, in order */
+    while (session->rx_received & 1u) {
+        uint8_t seq = (session->ack_sequence + 1) & MDS_SEQUENCE_MASK;
+
+        ret = upload_packet(session, config,
+                            &session->rx_window[seq & (MDS_RELIABLE_WINDOW_SIZE - 1)]);
+        if (ret < 0 && upload_ret == 0) {
+            upload_ret = ret;
         }
+
+        session->ack_sequence = seq;
+        session->rx_received >>= 1;
+        session->rx_unacked++;
     }
 
-    /* Upload chunk if callback is configured */
-    if (session->upload_callback != NULL) {
-        ret = session->upload_callback(config->data_uri,
-                                        config->authorization,
-                                        packet.data,
-                                        packet.data_len,
-                                        session->upload_user_data);
-        if (ret < 0) {
-            return ret;
+    /* Ack early on loss, otherwise before the device window fills */
+    if (gap || session->rx_unacked >= MDS_RELIABLE_WINDOW_SIZE / 2) {
+        ret = mds_stream_send_ack(session);
+        if (ret < 0 && upload_ret == 0) {
+            upload_ret = ret;
         }
     }
 
-    return 0;
+    return upload_ret;
+}
+
+int mds_stream_process(mds_session_t *session,
+                        const mds_device_config_t *config,
+                        int timeout_ms) {
+    if (session == NULL || config == NULL) {
+        return -EINVAL;
+    }
+
+    if (session->reliable) {
+        return stream_process_reliable(session, config, timeout_ms);
+    }
+
+    mds_rx_packet_t packet;
+    int ret = stream_receive(session, &packet, timeout_ms);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Sequence was validated and accounted by stream_receive() */
+
+    /* Upload chunk if callback is configured */
+    return upload_packet(session, config, &packet);
 }
 
 /* ============================================================================
@@ -316,6 +811,20 @@ bool mds_validate_sequence(uint8_t prev_seq, uint8_t new_seq) {
     return (new_seq == expected);
 }
 
+bool mds_validate_sequence_ext(uint16_t prev_seq, uint16_t new_seq) {
+    /* Expected next sequence */
+    uint16_t expected = (uint16_t)((prev_seq + 1) & MDS_SEQUENCE_MASK_EXT);
+
+    return (new_seq == expected);
+}
+
+uint16_t mds_count_lost_packets(uint16_t prev_seq, uint16_t new_seq, bool extended) {
+    uint16_t mask = extended ? MDS_SEQUENCE_MASK_EXT : MDS_SEQUENCE_MASK;
+
+    /* Distance from the expected sequence, modulo the counter width */
+    return (uint16_t)((new_seq - prev_seq - 1) & mask);
+}
+
 /* ============================================================================
  * Buffer-based API for FFI/External HID Transport
  * ========================================================================== */
@@ -381,6 +890,62 @@ int mds_parse_authorization(const uint8_t *buffer, size_t buffer_len,
     return 0;
 }
 
+int mds_parse_device_config(const uint8_t *buffer, size_t buffer_len,
+                            mds_device_config_t *config) {
+    if (buffer == NULL || config == NULL) {
+        return -EINVAL;
+    }
+
+    uint32_t seen = 0;
+    config->device_identifier[0] = '\0';
+    config->data_uri[0] = '\0';
+    config->authorization[0] = '\0';
+
+    size_t pos = 0;
+    while (pos + 2 <= buffer_len && buffer[pos] != 0) {
+        uint8_t type = buffer[pos];
+        size_t len = buffer[pos + 1];
+        const uint8_t *value = &buffer[pos + 2];
+
+        if (len > buffer_len - pos - 2) {
+            return -EINVAL;
+        }
+        pos += 2 + len;
+        if (type < 32) {
+            seen |= 1u << type;
+        }
+
+        switch (type) {
+        case MDS_CONFIG_TLV_SUPPORTED_FEATURES:
+            if (mds_parse_supported_features(value, len, &config->supported_features) < 0) {
+                return -EINVAL;
+            }
+            break;
+        case MDS_CONFIG_TLV_DEVICE_IDENTIFIER:
+            mds_parse_device_identifier(value, len, config->device_identifier,
+                                        sizeof(config->device_identifier));
+            break;
+        case MDS_CONFIG_TLV_DATA_URI:
+            mds_parse_data_uri(value, len, config->data_uri, sizeof(config->data_uri));
+            break;
+        case MDS_CONFIG_TLV_AUTHORIZATION:
+            mds_parse_authorization(value, len, config->authorization,
+                                    sizeof(config->authorization));
+            break;
+        default:
+            /* Newer firmware may add entries */
+            break;
+        }
+    }
+
+    /* A report cut short at an entry boundary is missing entries */
+    const uint32_t required = (1u << MDS_CONFIG_TLV_SUPPORTED_FEATURES) |
+                              (1u << MDS_CONFIG_TLV_DEVICE_IDENTIFIER) |
+                              (1u << MDS_CONFIG_TLV_DATA_URI) |
+                              (1u << MDS_CONFIG_TLV_AUTHORIZATION);
+    return (seen & required) == required ? 0 : -EINVAL;
+}
+
 int mds_build_stream_control(bool enable, uint8_t *buffer, size_t buffer_len) {
     if (buffer == NULL || buffer_len < 1) {
         return -EINVAL;
@@ -390,41 +955,222 @@ int mds_build_stream_control(bool enable, uint8_t *buffer, size_t buffer_len) {
     return 1;
 }
 
-int mds_parse_stream_packet(const uint8_t *buffer, size_t buffer_len,
-                             mds_stream_packet_t *packet) {
-    if (buffer == NULL || packet == NULL) {
+int mds_build_stream_control_mode(uint8_t mode, uint8_t *buffer, size_t buffer_len) {
+    if (buffer == NULL || buffer_len < 1) {
         return -EINVAL;
     }
 
-    if (buffer_len < 1) {
-        return -EINVAL;  /* Need at least sequence byte */
+    uint8_t base_mode = mode & ~(MDS_STREAM_MODE_FLAG_RELIABLE |
+                                 MDS_STREAM_MODE_FLAG_EXTENDED_SEQ |
+                                 MDS_STREAM_MODE_FLAG_COMPRESSED);
+
+    if (base_mode != MDS_STREAM_MODE_DISABLED &&
+        base_mode != MDS_STREAM_MODE_ENABLED &&
+        base_mode != MDS_STREAM_MODE_PRIORITY) {
+        return -EINVAL;
     }
 
-    /* Extract sequence number */
-    packet->sequence = mds_extract_sequence(buffer[0]);
+    if (base_mode == MDS_STREAM_MODE_DISABLED && base_mode != mode) {
+        return -EINVAL;  /* Mode flags only apply to an enabled stream */
+    }
+
+    buffer[0] = mode;
+    return 1;
+}
+
+int mds_build_stream_ack(uint8_t ack_sequence, uint32_t received,
+                         uint8_t *buffer, size_t buffer_len) {
+    if (buffer == NULL || buffer_len < MDS_STREAM_ACK_LEN) {
+        return -EINVAL;
+    }
+
+    /* Received bitmap is stored as little-endian 32-bit value */
+    buffer[0] = ack_sequence & MDS_SEQUENCE_MASK;
+    buffer[1] = (uint8_t)(received & 0xFF);
+    buffer[2] = (uint8_t)((received >> 8) & 0xFF);
+    buffer[3] = (uint8_t)((received >> 16) & 0xFF);
+    buffer[4] = (uint8_t)((received >> 24) & 0xFF);
+
+    return MDS_STREAM_ACK_LEN;
+}
 
-    /* Copy payload data */
-    packet->data_len = buffer_len - 1;  /* Exclude sequence byte */
+int mds_parse_stream_packet_view(const uint8_t *buffer, size_t buffer_len,
+                                 bool extended, mds_stream_packet_view_t *view) {
+    if (buffer == NULL || view == NULL) {
+        return -EINVAL;
+    }
+
+    if (extended) {
+        if (buffer_len < MDS_EXT_HEADER_LEN) {
+            return -EINVAL;  /* Need sequence and length bytes */
+        }
+
+        /* Payload length is explicit, trailing bytes are report padding */
+        if (buffer[2] > buffer_len - MDS_EXT_HEADER_LEN) {
+            return -EINVAL;
+        }
+
+        view->sequence = mds_extract_sequence_ext(buffer);
+        view->data = &buffer[MDS_EXT_HEADER_LEN];
+        view->data_len = buffer[2];
+    } else {
+        if (buffer_len < 1) {
+            return -EINVAL;  /* Need at least sequence byte */
+        }
+
+        view->sequence = mds_extract_sequence(buffer[0]);
+        view->data = &buffer[1];
+        view->data_len = buffer_len - 1;  /* Exclude sequence byte */
+    }
+
+    return 0;
+}
+
+/* Parse into a view, then copy the payload into packet */
+static int parse_stream_packet_copy(const uint8_t *buffer, size_t buffer_len, bool extended,
+                                    mds_stream_packet_t *packet) {
+    if (packet == NULL) {
+        return -EINVAL;
+    }
+
+    mds_stream_packet_view_t view;
+    int ret = mds_parse_stream_packet_view(buffer, buffer_len, extended, &view);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Reports larger than the packet structure are truncated */
+    packet->sequence = view.sequence;
+    packet->data_len = view.data_len;
     if (packet->data_len > MDS_MAX_CHUNK_DATA_LEN) {
         packet->data_len = MDS_MAX_CHUNK_DATA_LEN;
     }
-
     if (packet->data_len > 0) {
-        memcpy(packet->data, &buffer[1], packet->data_len);
+        memcpy(packet->data, view.data, packet->data_len);
     }
 
     return 0;
 }
 
-uint8_t mds_get_last_sequence(mds_session_t *session) {
+int mds_parse_stream_packet(const uint8_t *buffer, size_t buffer_len,
+                             mds_stream_packet_t *packet) {
+    return parse_stream_packet_copy(buffer, buffer_len, false, packet);
+}
+
+int mds_parse_stream_packet_ext(const uint8_t *buffer, size_t buffer_len,
+                                 mds_stream_packet_t *packet) {
+    return parse_stream_packet_copy(buffer, buffer_len, true, packet);
+}
+
+/* Decode an LZ4 block, returns decoded length or -EINVAL on malformed input */
+static int lz4_decompress_block(const uint8_t *src, size_t src_len,
+                                uint8_t *dst, size_t dst_len) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < src_len) {
+        uint8_t token = src[ip++];
+
+        /* Literals */
+        size_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= src_len) {
+                    return -EINVAL;
+                }
+                b = src[ip++];
+                lit_len += b;
+            } while (b == 255);
+        }
+
+        if (lit_len > src_len - ip || lit_len > dst_len - op) {
+            return -EINVAL;
+        }
+        memcpy(&dst[op], &src[ip], lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* Last sequence has no match */
+        if (ip == src_len) {
+            break;
+        }
+
+        /* Match */
+        if (src_len - ip < 2) {
+            return -EINVAL;
+        }
+        size_t offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -EINVAL;
+        }
+
+        size_t match_len = token & 0x0F;
+        if (match_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= src_len) {
+                    return -EINVAL;
+                }
+                b = src[ip++];
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += 4;
+
+        if (match_len > dst_len - op) {
+            return -EINVAL;
+        }
+
+        /* Byte-wise copy: source and destination may overlap */
+        for (size_t i = 0; i < match_len; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return (int)op;
+}
+
+int mds_decode_frame(const uint8_t *frame, size_t frame_len, bool stored,
+                     uint8_t *out, size_t out_len) {
+    if (frame == NULL || out == NULL || frame_len < MDS_FRAME_HEADER_LEN) {
+        return -EINVAL;
+    }
+
+    size_t chunk_len = (size_t)frame[0] | ((size_t)frame[1] << 8);
+    const uint8_t *body = &frame[MDS_FRAME_HEADER_LEN];
+    size_t body_len = frame_len - MDS_FRAME_HEADER_LEN;
+
+    if (chunk_len > out_len) {
+        return -ENOSPC;
+    }
+
+    if (stored) {
+        if (body_len != chunk_len) {
+            return -EINVAL;
+        }
+        memcpy(out, body, chunk_len);
+        return (int)chunk_len;
+    }
+
+    int ret = lz4_decompress_block(body, body_len, out, chunk_len);
+    if (ret < 0 || (size_t)ret != chunk_len) {
+        return -EINVAL;
+    }
+
+    return ret;
+}
+
+uint16_t mds_get_last_sequence(mds_session_t *session) {
     if (session == NULL) {
         return 0;
     }
     return session->last_sequence;
 }
 
-void mds_update_last_sequence(mds_session_t *session, uint8_t sequence) {
+void mds_update_last_sequence(mds_session_t *session, uint16_t sequence) {
     if (session != NULL) {
-        session->last_sequence = sequence & MDS_SEQUENCE_MASK;
+        session_record_sequence(session, sequence);
     }
 }
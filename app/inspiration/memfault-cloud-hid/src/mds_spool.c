@@ -0,0 +1,447 @@
+/**
+ * @file mds_spool.c
+ * @brief Memory-mapped chunk spool implementation
+ */
+
+#include "memfault_hid/mds_spool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* File layout: two header slots in the first page, then the record ring */
+#define SPOOL_MAGIC             0x4C4F5053u  /* "SPOL" */
+#define SPOOL_VERSION           1
+#define SPOOL_HEADER_SLOT_SIZE  64
+#define SPOOL_DATA_OFFSET       4096
+
+#define RECORD_MAGIC            0x4B4E4843u  /* "CHNK" */
+#define RECORD_WRAP_MAGIC       0x50415257u  /* "WRAP": rest of ring is padding */
+#define RECORD_ALIGN            8
+
+/* Header slot; the valid slot with the highest sequence is current */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;
+    uint64_t capacity;      /* Ring size */
+    uint64_t head;          /* Ring offset of the oldest record */
+    uint64_t tail;          /* Ring offset of the next append */
+    uint64_t used;          /* Bytes from head to tail, including wrap padding */
+    uint32_t count;         /* Records in the ring */
+    uint32_t crc;           /* CRC32 of the fields above */
+} spool_header_t;
+
+/* Record header, followed by uri, auth header (both NUL-terminated) and data */
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;           /* CRC32 of everything after this header */
+    uint32_t data_len;
+    uint16_t uri_len;       /* Including NUL */
+    uint16_t auth_len;      /* Including NUL */
+} spool_record_t;
+
+struct mds_spool {
+    int fd;
+    uint8_t *map;
+    size_t map_len;
+    uint8_t *ring;
+    spool_header_t state;   /* Last committed header */
+    size_t evicted;
+};
+
+/* ============================================================================
+ * Helpers
+ * ========================================================================== */
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t header_crc(const spool_header_t *header) {
+    return crc32_update(0, (const uint8_t *)header, offsetof(spool_header_t, crc));
+}
+
+static size_t record_size(size_t uri_len, size_t auth_len, size_t data_len) {
+    size_t size = sizeof(spool_record_t) + uri_len + auth_len + data_len;
+    return (size + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+/* Flush a byte range of the mapping; msync() needs a page-aligned start */
+static int flush_range(mds_spool_t *spool, size_t offset, size_t len) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset & ~(page - 1);
+
+    if (msync(spool->map + start, offset + len - start, MS_SYNC) != 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+/* Write the in-memory state to the inactive header slot and flush it */
+static int commit_header(mds_spool_t *spool) {
+    spool->state.sequence++;
+    spool->state.crc = header_crc(&spool->state);
+
+    size_t slot = (spool->state.sequence & 1) * SPOOL_HEADER_SLOT_SIZE;
+    memcpy(spool->map + slot, &spool->state, sizeof(spool->state));
+
+    return flush_range(spool, slot, sizeof(spool->state));
+}
+
+/* Ring offset of the oldest record, skipping wrap padding */
+static size_t head_record_offset(const mds_spool_t *spool, size_t *skipped) {
+    size_t head = spool->state.head;
+    size_t capacity = spool->state.capacity;
+
+    *skipped = 0;
+    if (head + sizeof(spool_record_t) > capacity ||
+        ((const spool_record_t *)(spool->ring + head))->magic == RECORD_WRAP_MAGIC) {
+        *skipped = capacity - head;
+        head = 0;
+    }
+    return head;
+}
+
+/* Drop the oldest record from the in-memory state (not committed) */
+static void drop_head(mds_spool_t *spool) {
+    size_t skipped;
+    size_t head = head_record_offset(spool, &skipped);
+    const spool_record_t *rec = (const spool_record_t *)(spool->ring + head);
+    size_t size = record_size(rec->uri_len, rec->auth_len, rec->data_len);
+
+    spool->state.used -= skipped + size;
+    spool->state.head = head + size;
+    spool->state.count--;
+
+    if (spool->state.count == 0) {
+        /* Restart at the beginning so large records do not need to wrap */
+        spool->state.head = 0;
+        spool->state.tail = 0;
+        spool->state.used = 0;
+    }
+}
+
+static bool record_valid(const mds_spool_t *spool, size_t offset) {
+    size_t capacity = spool->state.capacity;
+    if (offset + sizeof(spool_record_t) > capacity) {
+        return false;
+    }
+
+    const spool_record_t *rec = (const spool_record_t *)(spool->ring + offset);
+    if (rec->magic != RECORD_MAGIC || rec->uri_len == 0 || rec->auth_len == 0) {
+        return false;
+    }
+
+    size_t body_len = (size_t)rec->uri_len + rec->auth_len + rec->data_len;
+    if (offset + sizeof(*rec) + body_len > capacity) {
+        return false;
+    }
+
+    const uint8_t *body = (const uint8_t *)(rec + 1);
+    return crc32_update(0, body, body_len) == rec->crc &&
+           body[rec->uri_len - 1] == '\0' &&
+           body[rec->uri_len + rec->auth_len - 1] == '\0';
+}
+
+/* Walk committed records and cut the ring at the first corrupt one */
+static void recover_records(mds_spool_t *spool) {
+    spool_header_t *st = &spool->state;
+    uint32_t valid = 0;
+    size_t pos = st->head;
+    size_t used = 0;
+
+    while (valid < st->count) {
+        if (pos + sizeof(spool_record_t) > st->capacity ||
+            ((const spool_record_t *)(spool->ring + pos))->magic == RECORD_WRAP_MAGIC) {
+            used += st->capacity - pos;
+            pos = 0;
+        }
+
+        if (!record_valid(spool, pos)) {
+            break;
+        }
+
+        const spool_record_t *rec = (const spool_record_t *)(spool->ring + pos);
+        size_t size = record_size(rec->uri_len, rec->auth_len, rec->data_len);
+        pos += size;
+        used += size;
+        valid++;
+    }
+
+    if (valid != st->count) {
+        st->count = valid;
+        st->tail = pos;
+        st->used = used;
+        if (valid == 0) {
+            st->head = st->tail = st->used = 0;
+        }
+        commit_header(spool);
+    }
+}
+
+/* ============================================================================
+ * Spool Management
+ * ========================================================================== */
+
+int mds_spool_open(const char *path, size_t capacity, mds_spool_t **spool) {
+    if (path == NULL || spool == NULL || capacity < MDS_SPOOL_MIN_CAPACITY) {
+        return -EINVAL;
+    }
+
+    capacity = (capacity + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+
+    mds_spool_t *s = calloc(1, sizeof(mds_spool_t));
+    if (s == NULL) {
+        return -ENOMEM;
+    }
+
+    s->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (s->fd < 0) {
+        int err = -errno;
+        free(s);
+        return err;
+    }
+
+    /* Recover an existing spool's header to learn its capacity */
+    spool_header_t slots[2];
+    spool_header_t *current = NULL;
+    struct stat st;
+    int ret;
+
+    if (fstat(s->fd, &st) != 0) {
+        ret = -errno;
+        goto fail;
+    }
+
+    if ((size_t)st.st_size >= SPOOL_DATA_OFFSET &&
+        pread(s->fd, &slots[0], sizeof(slots[0]), 0) == sizeof(slots[0]) &&
+        pread(s->fd, &slots[1], sizeof(slots[1]), SPOOL_HEADER_SLOT_SIZE) == sizeof(slots[1])) {
+        for (int i = 0; i < 2; i++) {
+            spool_header_t *h = &slots[i];
+            bool valid = h->magic == SPOOL_MAGIC && h->version == SPOOL_VERSION &&
+                         h->crc == header_crc(h) &&
+                         (size_t)st.st_size >= SPOOL_DATA_OFFSET + h->capacity &&
+                         h->head < h->capacity && h->tail <= h->capacity &&
+                         h->used <= h->capacity;
+            if (valid && (current == NULL || h->sequence > current->sequence)) {
+                current = h;
+            }
+        }
+    }
+
+    if (current != NULL) {
+        capacity = current->capacity;
+    } else if (ftruncate(s->fd, (off_t)(SPOOL_DATA_OFFSET + capacity)) != 0) {
+        ret = -errno;
+        goto fail;
+    }
+
+    s->map_len = SPOOL_DATA_OFFSET + capacity;
+    s->map = mmap(NULL, s->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (s->map == MAP_FAILED) {
+        s->map = NULL;
+        ret = -errno;
+        goto fail;
+    }
+    s->ring = s->map + SPOOL_DATA_OFFSET;
+
+    if (current != NULL) {
+        s->state = *current;
+        recover_records(s);
+    } else {
+        memset(&s->state, 0, sizeof(s->state));
+        s->state.magic = SPOOL_MAGIC;
+        s->state.version = SPOOL_VERSION;
+        s->state.capacity = capacity;
+        ret = commit_header(s);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    *spool = s;
+    return 0;
+
+fail:
+    if (s->map != NULL) {
+        munmap(s->map, s->map_len);
+    }
+    close(s->fd);
+    free(s);
+    return ret;
+}
+
+void mds_spool_close(mds_spool_t *spool) {
+    if (spool == NULL) {
+        return;
+    }
+
+    if (spool->map != NULL) {
+        munmap(spool->map, spool->map_len);
+    }
+    close(spool->fd);
+    free(spool);
+}
+
+/* ============================================================================
+ * Records
+ * ========================================================================== */
+
+int mds_spool_append(mds_spool_t *spool,
+                     const char *uri,
+                     const char *auth_header,
+                     const uint8_t *chunk_data,
+                     size_t chunk_len) {
+    if (spool == NULL || uri == NULL || auth_header == NULL ||
+        (chunk_data == NULL && chunk_len > 0)) {
+        return -EINVAL;
+    }
+
+    size_t uri_len = strlen(uri) + 1;
+    size_t auth_len = strlen(auth_header) + 1;
+    if (uri_len > UINT16_MAX || auth_len > UINT16_MAX || chunk_len > UINT32_MAX) {
+        return -EINVAL;
+    }
+
+    spool_header_t *st = &spool->state;
+    size_t size = record_size(uri_len, auth_len, chunk_len);
+    if (size > st->capacity) {
+        return -EMSGSIZE;
+    }
+
+    /* Make room: a record never straddles the end of the ring */
+    size_t pad;
+    bool evicted = false;
+    for (;;) {
+        pad = (st->tail + size > st->capacity) ? st->capacity - st->tail : 0;
+        if (st->used + pad + size <= st->capacity) {
+            break;
+        }
+        drop_head(spool);
+        spool->evicted++;
+        evicted = true;
+    }
+
+    /*
+     * Commit the new head before reusing the evicted bytes; otherwise a
+     * crash mid-write leaves the on-disk head pointing at overwritten data
+     * and recovery discards the whole spool.
+     */
+    int ret;
+    if (evicted) {
+        ret = commit_header(spool);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (pad > 0) {
+        /* Recovery needs the marker to find the record at the ring start */
+        if (pad >= sizeof(uint32_t)) {
+            uint32_t wrap = RECORD_WRAP_MAGIC;
+            memcpy(spool->ring + st->tail, &wrap, sizeof(wrap));
+            ret = flush_range(spool, SPOOL_DATA_OFFSET + st->tail, sizeof(wrap));
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        st->used += pad;
+        st->tail = 0;
+    }
+
+    /* Write and flush the record before it becomes visible in the header */
+    size_t offset = st->tail;
+    spool_record_t rec = {
+        .magic = RECORD_MAGIC,
+        .data_len = (uint32_t)chunk_len,
+        .uri_len = (uint16_t)uri_len,
+        .auth_len = (uint16_t)auth_len,
+    };
+    uint8_t *body = spool->ring + offset + sizeof(rec);
+    memcpy(body, uri, uri_len);
+    memcpy(body + uri_len, auth_header, auth_len);
+    if (chunk_len > 0) {
+        memcpy(body + uri_len + auth_len, chunk_data, chunk_len);
+    }
+    rec.crc = crc32_update(0, body, uri_len + auth_len + chunk_len);
+    memcpy(spool->ring + offset, &rec, sizeof(rec));
+
+    ret = flush_range(spool, SPOOL_DATA_OFFSET + offset, size);
+    if (ret < 0) {
+        return ret;
+    }
+
+    st->tail = offset + size;
+    st->used += size;
+    st->count++;
+
+    return commit_header(spool);
+}
+
+int mds_spool_peek(mds_spool_t *spool,
+                   const char **uri,
+                   const char **auth_header,
+                   const uint8_t **chunk_data,
+                   size_t *chunk_len) {
+    if (spool == NULL || uri == NULL || auth_header == NULL ||
+        chunk_data == NULL || chunk_len == NULL) {
+        return -EINVAL;
+    }
+
+    if (spool->state.count == 0) {
+        return -ENOENT;
+    }
+
+    size_t skipped;
+    size_t head = head_record_offset(spool, &skipped);
+    const spool_record_t *rec = (const spool_record_t *)(spool->ring + head);
+    const char *body = (const char *)(rec + 1);
+
+    *uri = body;
+    *auth_header = body + rec->uri_len;
+    *chunk_data = (const uint8_t *)(body + rec->uri_len + rec->auth_len);
+    *chunk_len = rec->data_len;
+
+    return 0;
+}
+
+int mds_spool_pop(mds_spool_t *spool) {
+    if (spool == NULL) {
+        return -EINVAL;
+    }
+
+    if (spool->state.count == 0) {
+        return -ENOENT;
+    }
+
+    drop_head(spool);
+    return commit_header(spool);
+}
+
+bool mds_spool_is_empty(mds_spool_t *spool) {
+    return spool == NULL || spool->state.count == 0;
+}
+
+int mds_spool_get_stats(mds_spool_t *spool, mds_spool_stats_t *stats) {
+    if (spool == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    stats->chunks = spool->state.count;
+    stats->bytes_used = spool->state.used;
+    stats->capacity = spool->state.capacity;
+    stats->chunks_evicted = spool->evicted;
+
+    return 0;
+}
@@ -5,21 +5,674 @@
 
 #include "memfault_hid/mds_upload.h"
 #include <curl/curl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <zlib.h>
+
+/* TCP keepalive probing for idle pooled connections */
+#define MDS_UPLOAD_KEEPALIVE_IDLE_S     30L
+#define MDS_UPLOAD_KEEPALIVE_INTVL_S    15L
+
+/* Maximum idle time before a pooled connection is no longer reused */
+#define MDS_UPLOAD_MAX_CONN_AGE_S       600L
+
+/* Concurrent requests (and so connections) per host unless configured */
+#define MDS_UPLOAD_DEFAULT_MAX_CONNS_PER_HOST 4
+
+/* Spooled chunks uploaded per poll, so one call never blocks for long */
+#define MDS_SPOOL_DRAIN_BATCH           8
+
+/* Minimum delay between drain attempts after a spooled upload fails */
+#define MDS_SPOOL_RETRY_INTERVAL_MS     5000
+
+/* Retry timer wheel: 64 slots of 100 ms, one revolution every 6.4 s */
+#define MDS_RETRY_WHEEL_SLOTS           64
+#define MDS_RETRY_WHEEL_TICK_MS         100
+
+/* Retries attempted per poll, so one call never blocks for long */
+#define MDS_RETRY_BATCH                 8
+
+/* Number of distinct authorization headers kept ready for reuse */
+#define MDS_HEADER_CACHE_SIZE 4
+
+/* Number of mds_upload_encoding_t values */
+#define MDS_UPLOAD_ENCODING_COUNT       3
+
+/* Prepared request headers for one authorization header */
+typedef struct {
+    char *auth_header;              /* Key: raw "Name:Value" string */
+    /* Authorization + Content-Type (+ Content-Encoding), built on first use */
+    struct curl_slist *headers[MDS_UPLOAD_ENCODING_COUNT];
+    uint64_t last_used;
+} mds_header_cache_entry_t;
+
+/*
+ * Pooled easy handle. A handle is used by one request at a time, so its
+ * header cache needs no locking. Connections live in the shared cache.
+ */
+typedef struct mds_upload_handle {
+    struct mds_upload_handle *next;
+    CURL *curl;
+    mds_header_cache_entry_t header_cache[MDS_HEADER_CACHE_SIZE];
+    uint64_t header_cache_clock;
+
+    /* Request body compression, reused between requests */
+    z_stream zstream;
+    bool zstream_ready;
+    mds_upload_encoding_t zstream_encoding;
+    int zstream_level;
+    uint8_t *zbuf;
+    size_t zbuf_size;
+} mds_upload_handle_t;
+
+/* Requests in flight to one host ("scheme://authority" of the URI) */
+typedef struct mds_upload_host {
+    struct mds_upload_host *next;
+    size_t in_flight;
+    char name[];
+} mds_upload_host_t;
+
+/* Token bucket for one host and authorization header pair */
+typedef struct mds_rate_bucket {
+    struct mds_rate_bucket *next;
+    double tokens;                  /* Negative while requests are queued */
+    uint64_t updated_ms;
+    char key[];                     /* "scheme://authority" + '\n' + auth header */
+} mds_rate_bucket_t;
+
+/* Recent chunk fingerprints for one device, most recently seen first */
+typedef struct mds_dedup_device {
+    struct mds_dedup_device *next;
+    uint32_t key;                   /* device_key() of uri, checked first */
+    char *uri;                      /* Data URI identifying the device */
+    size_t count;                   /* Valid fingerprints */
+    size_t head;                    /* Next slot to overwrite */
+    uint64_t fingerprints[];        /* dedup_history entries */
+} mds_dedup_device_t;
+
+/* Histogram updated with atomics so concurrent writers need no lock */
+typedef struct {
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+    atomic_uint_fast64_t buckets[MDS_HISTOGRAM_BUCKETS];
+} mds_atomic_histogram_t;
+
+/* Counters of mds_upload_stats_t, updated without the uploader lock */
+typedef struct {
+    atomic_size_t chunks_uploaded;
+    atomic_size_t bytes_uploaded;
+    atomic_size_t upload_failures;
+    atomic_long last_http_status;
+    atomic_size_t chunks_spooled;
+    atomic_size_t chunks_drained;
+    atomic_size_t spool_failures;
+    atomic_size_t retries;
+    atomic_size_t retries_exhausted;
+    atomic_size_t chunks_compressed;
+    atomic_size_t bytes_saved;
+    atomic_size_t rate_limited;
+    atomic_uint_fast64_t rate_limit_delay_ms;
+    atomic_size_t duplicates_suppressed;
+} mds_atomic_counters_t;
+
+#define STAT_ADD(uploader, field, n) \
+    atomic_fetch_add_explicit(&(uploader)->counters.field, (n), memory_order_relaxed)
+
+/* Chunk waiting for a retry; uri and auth header are stored after the data */
+typedef struct mds_retry_entry {
+    struct mds_retry_entry *next;
+    uint64_t due_ms;
+    uint32_t attempts;              /* Attempts made so far */
+    const char *uri;
+    const char *auth_header;
+    size_t chunk_len;
+    uint8_t chunk_data[];
+} mds_retry_entry_t;
 
 /* Uploader structure */
 struct mds_uploader {
-    CURL *curl;
-    struct curl_slist *headers;
-    mds_upload_stats_t stats;
-    long timeout_ms;
-    bool verbose;
+    /* Connection pool; idle_handles and hosts are protected by lock */
+    CURLSH *share;
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+    mds_upload_handle_t *idle_handles;
+    mds_upload_host_t *hosts;
+    size_t max_conns_per_host;
+    pthread_cond_t host_available;
+
+    mds_atomic_counters_t counters;
+    mds_atomic_histogram_t latency_us;
+    mds_atomic_histogram_t tls_handshake_us;
+    mds_atomic_histogram_t request_bytes;
+    atomic_long timeout_ms;
+    atomic_bool verbose;
+    atomic_int encoding;            /* mds_upload_encoding_t */
+    atomic_int compression_level;
+    atomic_size_t compression_min_size;
+
+    /* Everything below is protected by lock */
+    pthread_mutex_t lock;
+    mds_spool_t *spool;
+    uint64_t spool_retry_at_ms;     /* No drain attempts before this time */
+    uint32_t spool_failed_attempts; /* Consecutive transient drain failures */
+    bool spool_draining;            /* A thread is uploading the spool head */
+
+    /* Rate limiting */
+    double rate_limit;              /* Requests per second, 0 when disabled */
+    uint32_t rate_burst;
+    mds_rate_bucket_t *rate_buckets;
+    size_t rate_buckets_count;
+    size_t rate_waiting;
+
+    /* Duplicate chunk suppression */
+    size_t dedup_history;           /* Fingerprints per device, 0 when disabled */
+    mds_dedup_device_t *dedup_devices;
+    size_t dedup_devices_count;
+
+    /* Retry scheduling */
+    mds_retry_policy_t retry_policy;
+    mds_retry_entry_t *retry_wheel[MDS_RETRY_WHEEL_SLOTS];
+    uint64_t retry_tick;            /* Last wheel tick swept */
+    mds_retry_entry_t *retry_ready; /* Due retries, oldest first */
+    mds_retry_entry_t **retry_ready_tail;
+    size_t retries_pending;
+    uint64_t rng_state;
+};
+
+static void retry_release_all(mds_uploader_t *uploader);
+static void dedup_clear(mds_uploader_t *uploader);
+static uint64_t retry_delay_ms(mds_uploader_t *uploader, uint32_t attempts, long retry_after_ms);
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* ============================================================================
+ * Histograms
+ * ========================================================================== */
+
+static size_t histogram_bucket(uint64_t value) {
+    if (value < 4) {
+        return (size_t)value;
+    }
+
+    unsigned int exp = 0;
+    while ((value >> exp) > 1) {
+        exp++;
+    }
+    if (exp >= 32) {
+        return MDS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    /* Top two bits below the leading one select the sub-bucket */
+    return 4 + (exp - 2) * 4 + (size_t)((value >> (exp - 2)) & 3);
+}
+
+/* Largest value that falls in a bucket */
+static uint64_t histogram_bucket_limit(size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+
+    unsigned int exp = (unsigned int)(bucket - 4) / 4 + 2;
+    uint64_t sub = (bucket - 4) % 4;
+    return ((5 + sub) << (exp - 2)) - 1;
+}
+
+static void histogram_record(mds_atomic_histogram_t *histogram, uint64_t value) {
+    atomic_fetch_add_explicit(&histogram->buckets[histogram_bucket(value)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+
+    uint_fast64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+/* Copy a histogram, clearing each field in the same atomic step if reset */
+static void histogram_snapshot(mds_atomic_histogram_t *histogram,
+                               mds_histogram_t *out,
+                               bool reset) {
+#define HISTOGRAM_READ(field) \
+    (reset ? atomic_exchange_explicit(&(field), 0, memory_order_relaxed) \
+           : atomic_load_explicit(&(field), memory_order_relaxed))
+
+    out->count = 0;
+    for (size_t i = 0; i < MDS_HISTOGRAM_BUCKETS; i++) {
+        out->buckets[i] = HISTOGRAM_READ(histogram->buckets[i]);
+        out->count += out->buckets[i];
+    }
+    out->sum = HISTOGRAM_READ(histogram->sum);
+    out->max = HISTOGRAM_READ(histogram->max);
+
+#undef HISTOGRAM_READ
+}
+
+uint64_t mds_histogram_percentile(const mds_histogram_t *histogram, double quantile) {
+    if (histogram == NULL || histogram->count == 0) {
+        return 0;
+    }
+
+    if (quantile < 0.0) {
+        quantile = 0.0;
+    } else if (quantile > 1.0) {
+        quantile = 1.0;
+    }
+
+    uint64_t rank = (uint64_t)(quantile * (double)histogram->count);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < MDS_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint64_t limit = histogram_bucket_limit(i);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+/* ============================================================================
+ * Header Cache
+ * ========================================================================== */
+
+static const char *const content_encoding_headers[MDS_UPLOAD_ENCODING_COUNT] = {
+    [MDS_UPLOAD_ENCODING_NONE] = NULL,
+    [MDS_UPLOAD_ENCODING_GZIP] = "Content-Encoding: gzip",
+    [MDS_UPLOAD_ENCODING_DEFLATE] = "Content-Encoding: deflate",
 };
 
+static void header_cache_entry_clear(mds_header_cache_entry_t *entry) {
+    for (size_t i = 0; i < MDS_UPLOAD_ENCODING_COUNT; i++) {
+        curl_slist_free_all(entry->headers[i]);
+    }
+    free(entry->auth_header);
+    memset(entry, 0, sizeof(*entry));
+}
+
+/* Build the curl header list for an authorization header ("Name:Value") */
+static struct curl_slist *build_headers(const char *auth_header, mds_upload_encoding_t encoding) {
+    const char *colon = strchr(auth_header, ':');
+    if (colon == NULL) {
+        fprintf(stderr, "Invalid authorization header format: %s\n", auth_header);
+        return NULL;
+    }
+
+    /* Build full header string for curl: name + ": " + value + \0 */
+    int name_len = (int)(colon - auth_header);
+    const char *header_value = colon + 1;
+    size_t full_header_len = (size_t)name_len + 2 + strlen(header_value) + 1;
+    char *full_header = malloc(full_header_len);
+    if (full_header == NULL) {
+        return NULL;
+    }
+    snprintf(full_header, full_header_len, "%.*s: %s", name_len, auth_header, header_value);
+
+    struct curl_slist *headers = curl_slist_append(NULL, full_header);
+    free(full_header);
+    if (headers == NULL) {
+        return NULL;
+    }
+
+    struct curl_slist *list = curl_slist_append(headers, "Content-Type: application/octet-stream");
+    if (list == NULL) {
+        curl_slist_free_all(headers);
+        return NULL;
+    }
+
+    if (content_encoding_headers[encoding] != NULL &&
+        curl_slist_append(list, content_encoding_headers[encoding]) == NULL) {
+        curl_slist_free_all(list);
+        return NULL;
+    }
+
+    return list;
+}
+
+/*
+ * Look up the prepared headers for an authorization header, building them on
+ * a miss. Headers only depend on the authorization, so devices sharing a
+ * project key share an entry. Hits do not allocate.
+ */
+static struct curl_slist *header_cache_get(mds_upload_handle_t *handle,
+                                           const char *auth_header,
+                                           mds_upload_encoding_t encoding) {
+    mds_header_cache_entry_t *victim = &handle->header_cache[0];
+
+    for (size_t i = 0; i < MDS_HEADER_CACHE_SIZE; i++) {
+        mds_header_cache_entry_t *entry = &handle->header_cache[i];
+
+        if (entry->auth_header != NULL && strcmp(entry->auth_header, auth_header) == 0) {
+            if (entry->headers[encoding] == NULL) {
+                entry->headers[encoding] = build_headers(auth_header, encoding);
+            }
+            entry->last_used = ++handle->header_cache_clock;
+            return entry->headers[encoding];
+        }
+
+        /* Prefer an empty slot, otherwise the least recently used */
+        if (victim->auth_header != NULL &&
+            (entry->auth_header == NULL || entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+
+    struct curl_slist *headers = build_headers(auth_header, encoding);
+    if (headers == NULL) {
+        return NULL;
+    }
+
+    char *key = strdup(auth_header);
+    if (key == NULL) {
+        curl_slist_free_all(headers);
+        return NULL;
+    }
+
+    header_cache_entry_clear(victim);
+    victim->auth_header = key;
+    victim->headers[encoding] = headers;
+    victim->last_used = ++handle->header_cache_clock;
+
+    return headers;
+}
+
+/* ============================================================================
+ * Body Compression
+ * ========================================================================== */
+
+/*
+ * Compress a request body into the handle's buffer. Returns the compressed
+ * length, or 0 if the body should be sent uncompressed (no gain or error).
+ */
+static size_t compress_body(mds_upload_handle_t *handle,
+                            mds_upload_encoding_t encoding,
+                            int level,
+                            const uint8_t *data,
+                            size_t len) {
+    /* Re-create the stream only when the format or level changes */
+    if (handle->zstream_ready &&
+        (handle->zstream_encoding != encoding || handle->zstream_level != level)) {
+        deflateEnd(&handle->zstream);
+        handle->zstream_ready = false;
+    }
+
+    if (!handle->zstream_ready) {
+        memset(&handle->zstream, 0, sizeof(handle->zstream));
+        int window_bits = (encoding == MDS_UPLOAD_ENCODING_GZIP) ? 15 + 16 : 15;
+        if (deflateInit2(&handle->zstream, level, Z_DEFLATED, window_bits, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            return 0;
+        }
+        handle->zstream_ready = true;
+        handle->zstream_encoding = encoding;
+        handle->zstream_level = level;
+    } else if (deflateReset(&handle->zstream) != Z_OK) {
+        return 0;
+    }
+
+    /* Output larger than the input is useless, so that is all the room needed */
+    if (handle->zbuf_size < len) {
+        uint8_t *buf = realloc(handle->zbuf, len);
+        if (buf == NULL) {
+            return 0;
+        }
+        handle->zbuf = buf;
+        handle->zbuf_size = len;
+    }
+
+    handle->zstream.next_in = (Bytef *)data;
+    handle->zstream.avail_in = (uInt)len;
+    handle->zstream.next_out = handle->zbuf;
+    handle->zstream.avail_out = (uInt)len;
+
+    if (deflate(&handle->zstream, Z_FINISH) != Z_STREAM_END) {
+        return 0;  /* Did not fit: not compressible */
+    }
+
+    return len - handle->zstream.avail_out;
+}
+
+/* ============================================================================
+ * Connection Pool
+ * ========================================================================== */
+
+static void share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userptr) {
+    (void)curl;
+    (void)access;
+    mds_uploader_t *uploader = userptr;
+    pthread_mutex_lock(&uploader->share_locks[data]);
+}
+
+static void share_unlock(CURL *curl, curl_lock_data data, void *userptr) {
+    (void)curl;
+    mds_uploader_t *uploader = userptr;
+    pthread_mutex_unlock(&uploader->share_locks[data]);
+}
+
+/*
+ * Options that stay the same for every request. These are set once so that
+ * the handle persists between uploads; only per-request options are set in
+ * perform_upload(). Connections, TLS sessions and DNS results live in the
+ * uploader's share object, so any pooled handle can reuse them.
+ */
+static void configure_handle(CURL *curl, CURLSH *share) {
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+
+    /* Keep idle connections alive so a chunk after a quiet period reuses them */
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, MDS_UPLOAD_KEEPALIVE_IDLE_S);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, MDS_UPLOAD_KEEPALIVE_INTVL_S);
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, MDS_UPLOAD_MAX_CONN_AGE_S);
+
+    /* Resume TLS sessions when a new connection is needed (abbreviated handshake) */
+    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+}
+
+static void handle_destroy(mds_upload_handle_t *handle) {
+    for (size_t i = 0; i < MDS_HEADER_CACHE_SIZE; i++) {
+        header_cache_entry_clear(&handle->header_cache[i]);
+    }
+    if (handle->zstream_ready) {
+        deflateEnd(&handle->zstream);
+    }
+    free(handle->zbuf);
+    curl_easy_cleanup(handle->curl);
+    free(handle);
+}
+
+/* Length of the "scheme://authority" prefix of a URI */
+static size_t host_key_len(const char *uri) {
+    const char *authority = strstr(uri, "://");
+    authority = (authority != NULL) ? authority + 3 : uri;
+    return (size_t)(authority - uri) + strcspn(authority, "/?#");
+}
+
+/* Find or add the host entry for a URI; called with lock held */
+static mds_upload_host_t *host_get(mds_uploader_t *uploader, const char *uri) {
+    size_t len = host_key_len(uri);
+
+    for (mds_upload_host_t *host = uploader->hosts; host != NULL; host = host->next) {
+        if (strncmp(host->name, uri, len) == 0 && host->name[len] == '\0') {
+            return host;
+        }
+    }
+
+    mds_upload_host_t *host = calloc(1, sizeof(*host) + len + 1);
+    if (host == NULL) {
+        return NULL;
+    }
+    memcpy(host->name, uri, len);
+    host->next = uploader->hosts;
+    uploader->hosts = host;
+    return host;
+}
+
+/*
+ * Take an idle handle for a request to uri, waiting while the host is at its
+ * connection limit. Called without lock. Returns NULL on allocation failure.
+ */
+static mds_upload_handle_t *handle_acquire(mds_uploader_t *uploader,
+                                           const char *uri,
+                                           mds_upload_host_t **host_out) {
+    pthread_mutex_lock(&uploader->lock);
+
+    mds_upload_host_t *host = host_get(uploader, uri);
+    if (host == NULL) {
+        pthread_mutex_unlock(&uploader->lock);
+        return NULL;
+    }
+
+    while (host->in_flight >= uploader->max_conns_per_host) {
+        pthread_cond_wait(&uploader->host_available, &uploader->lock);
+    }
+    host->in_flight++;
+
+    mds_upload_handle_t *handle = uploader->idle_handles;
+    if (handle != NULL) {
+        uploader->idle_handles = handle->next;
+    }
+
+    pthread_mutex_unlock(&uploader->lock);
+
+    if (handle == NULL) {
+        handle = calloc(1, sizeof(*handle));
+        if (handle != NULL) {
+            handle->curl = curl_easy_init();
+            if (handle->curl == NULL) {
+                free(handle);
+                handle = NULL;
+            } else {
+                configure_handle(handle->curl, uploader->share);
+            }
+        }
+
+        if (handle == NULL) {
+            pthread_mutex_lock(&uploader->lock);
+            host->in_flight--;
+            pthread_cond_broadcast(&uploader->host_available);
+            pthread_mutex_unlock(&uploader->lock);
+            return NULL;
+        }
+    }
+
+    *host_out = host;
+    return handle;
+}
+
+static void handle_release(mds_uploader_t *uploader,
+                           mds_upload_handle_t *handle,
+                           mds_upload_host_t *host) {
+    pthread_mutex_lock(&uploader->lock);
+    handle->next = uploader->idle_handles;
+    uploader->idle_handles = handle;
+    host->in_flight--;
+    pthread_cond_broadcast(&uploader->host_available);
+    pthread_mutex_unlock(&uploader->lock);
+}
+
+/* ============================================================================
+ * Rate Limiting
+ * ========================================================================== */
+
+/* Find or add the bucket for a request; called with lock held */
+static mds_rate_bucket_t *rate_bucket_get(mds_uploader_t *uploader,
+                                          const char *uri,
+                                          const char *auth_header,
+                                          uint64_t now) {
+    size_t host_len = host_key_len(uri);
+    size_t auth_len = strlen(auth_header);
+
+    for (mds_rate_bucket_t *bucket = uploader->rate_buckets; bucket != NULL;
+         bucket = bucket->next) {
+        if (strncmp(bucket->key, uri, host_len) == 0 && bucket->key[host_len] == '\n' &&
+            strcmp(&bucket->key[host_len + 1], auth_header) == 0) {
+            return bucket;
+        }
+    }
+
+    mds_rate_bucket_t *bucket = malloc(sizeof(*bucket) + host_len + 1 + auth_len + 1);
+    if (bucket == NULL) {
+        return NULL;
+    }
+    memcpy(bucket->key, uri, host_len);
+    bucket->key[host_len] = '\n';
+    memcpy(&bucket->key[host_len + 1], auth_header, auth_len + 1);
+    bucket->tokens = uploader->rate_burst;
+    bucket->updated_ms = now;
+    bucket->next = uploader->rate_buckets;
+    uploader->rate_buckets = bucket;
+    uploader->rate_buckets_count++;
+    return bucket;
+}
+
+/*
+ * Take a token for a request, sleeping until one is available. A request
+ * that finds the bucket empty reserves the next token (driving the count
+ * negative) and sleeps until it accrues, so waiters are served in order and
+ * none are dropped. Called without lock.
+ */
+static void rate_limit_acquire(mds_uploader_t *uploader, const char *uri, const char *auth_header) {
+    uint64_t now = monotonic_ms();
+    uint64_t wait_ms = 0;
+
+    pthread_mutex_lock(&uploader->lock);
+
+    if (uploader->rate_limit > 0) {
+        mds_rate_bucket_t *bucket = rate_bucket_get(uploader, uri, auth_header, now);
+        if (bucket != NULL) {
+            bucket->tokens += (double)(now - bucket->updated_ms) * uploader->rate_limit / 1000.0;
+            if (bucket->tokens > uploader->rate_burst) {
+                bucket->tokens = uploader->rate_burst;
+            }
+            bucket->updated_ms = now;
+
+            bucket->tokens -= 1.0;
+            if (bucket->tokens < 0) {
+                wait_ms = (uint64_t)(-bucket->tokens * 1000.0 / uploader->rate_limit + 0.5);
+            }
+        }
+    }
+
+    if (wait_ms > 0) {
+        uploader->rate_waiting++;
+    }
+
+    pthread_mutex_unlock(&uploader->lock);
+
+    if (wait_ms == 0) {
+        return;
+    }
+
+    STAT_ADD(uploader, rate_limited, 1);
+    STAT_ADD(uploader, rate_limit_delay_ms, wait_ms);
+
+    struct timespec ts = {
+        .tv_sec = (time_t)(wait_ms / 1000),
+        .tv_nsec = (long)(wait_ms % 1000) * 1000000L,
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    uploader->rate_waiting--;
+    pthread_mutex_unlock(&uploader->lock);
+}
+
 /* ============================================================================
  * Uploader Management
  * ========================================================================== */
@@ -30,16 +683,43 @@ mds_uploader_t *mds_uploader_create(void) {
         return NULL;
     }
 
-    /* Initialize libcurl */
-    uploader->curl = curl_easy_init();
-    if (uploader->curl == NULL) {
+    /* Initialize libcurl connection, TLS session and DNS sharing */
+    uploader->share = curl_share_init();
+    if (uploader->share == NULL) {
         free(uploader);
         return NULL;
     }
 
+    for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&uploader->share_locks[i], NULL);
+    }
+    pthread_mutex_init(&uploader->lock, NULL);
+    pthread_cond_init(&uploader->host_available, NULL);
+
+    curl_share_setopt(uploader->share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(uploader->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(uploader->share, CURLSHOPT_USERDATA, uploader);
+    curl_share_setopt(uploader->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(uploader->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(uploader->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+
+    uploader->max_conns_per_host = MDS_UPLOAD_DEFAULT_MAX_CONNS_PER_HOST;
+
     /* Set default timeout (30 seconds) */
-    uploader->timeout_ms = 30000;
-    uploader->verbose = false;
+    atomic_init(&uploader->timeout_ms, 30000);
+    atomic_init(&uploader->verbose, false);
+    atomic_init(&uploader->encoding, MDS_UPLOAD_ENCODING_NONE);
+    atomic_init(&uploader->compression_level, Z_DEFAULT_COMPRESSION);
+    atomic_init(&uploader->compression_min_size, 0);
+
+    /* Retries disabled until a policy is set */
+    uploader->retry_policy.max_attempts = 1;
+    uploader->retry_tick = monotonic_ms() / MDS_RETRY_WHEEL_TICK_MS;
+    uploader->retry_ready_tail = &uploader->retry_ready;
+    uploader->rng_state = monotonic_ms() ^ (uint64_t)(uintptr_t)uploader;
+    if (uploader->rng_state == 0) {
+        uploader->rng_state = 1;
+    }
 
     return uploader;
 }
@@ -49,140 +729,907 @@ void mds_uploader_destroy(mds_uploader_t *uploader) {
         return;
     }
 
-    if (uploader->headers) {
-        curl_slist_free_all(uploader->headers);
+    pthread_mutex_lock(&uploader->lock);
+    retry_release_all(uploader);
+    dedup_clear(uploader);
+    pthread_mutex_unlock(&uploader->lock);
+
+    /* No requests may be in flight, so every handle is idle */
+    while (uploader->idle_handles != NULL) {
+        mds_upload_handle_t *handle = uploader->idle_handles;
+        uploader->idle_handles = handle->next;
+        handle_destroy(handle);
     }
 
-    if (uploader->curl) {
-        curl_easy_cleanup(uploader->curl);
+    while (uploader->rate_buckets != NULL) {
+        mds_rate_bucket_t *bucket = uploader->rate_buckets;
+        uploader->rate_buckets = bucket->next;
+        free(bucket);
     }
 
+    while (uploader->hosts != NULL) {
+        mds_upload_host_t *host = uploader->hosts;
+        uploader->hosts = host->next;
+        free(host);
+    }
+
+    curl_share_cleanup(uploader->share);
+
+    for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&uploader->share_locks[i]);
+    }
+    pthread_mutex_destroy(&uploader->lock);
+    pthread_cond_destroy(&uploader->host_available);
+
     free(uploader);
 }
 
 /* ============================================================================
- * Upload Callback
+ * Upload
  * ========================================================================== */
 
-int mds_uploader_callback(const char *uri,
+/*
+ * POST one chunk. Returns 0 on success, -EAGAIN for failures worth retrying
+ * later (network errors, 408, 429, 5xx), or another negative error code.
+ * Called without lock. If retry_after_ms is not NULL it receives the
+ * response's Retry-After in milliseconds, or -1.
+ */
+static int perform_upload(mds_uploader_t *uploader,
+                          const char *uri,
                           const char *auth_header,
                           const uint8_t *chunk_data,
                           size_t chunk_len,
-                          void *user_data) {
-    if (uri == NULL || auth_header == NULL || chunk_data == NULL || user_data == NULL) {
-        return -EINVAL;
-    }
-
-    mds_uploader_t *uploader = (mds_uploader_t *)user_data;
+                          long *retry_after_ms) {
     CURLcode res;
+    bool verbose = atomic_load(&uploader->verbose);
 
-    /* Reset curl for new request */
-    curl_easy_reset(uploader->curl);
-
-    /* Set URL */
-    curl_easy_setopt(uploader->curl, CURLOPT_URL, uri);
-
-    /* Set POST method */
-    curl_easy_setopt(uploader->curl, CURLOPT_POST, 1L);
-
-    /* Set POST data */
-    curl_easy_setopt(uploader->curl, CURLOPT_POSTFIELDS, chunk_data);
-    curl_easy_setopt(uploader->curl, CURLOPT_POSTFIELDSIZE, (long)chunk_len);
+    if (retry_after_ms != NULL) {
+        *retry_after_ms = -1;
+    }
 
-    /* Parse authorization header (format: "HeaderName:HeaderValue") */
-    const char *colon = strchr(auth_header, ':');
-    if (colon == NULL) {
+    /* Prepared headers (format: "HeaderName:HeaderValue"), parsed once per auth */
+    if (strchr(auth_header, ':') == NULL) {
         fprintf(stderr, "Invalid authorization header format: %s\n", auth_header);
-        uploader->stats.upload_failures++;
+        STAT_ADD(uploader, upload_failures, 1);
         return -EINVAL;
     }
 
-    /* Extract header name and value */
-    size_t header_name_len = colon - auth_header;
-    char *header_name = malloc(header_name_len + 1);
-    if (header_name == NULL) {
-        uploader->stats.upload_failures++;
+    /* Wait for the rate limiter before taking a connection slot */
+    rate_limit_acquire(uploader, uri, auth_header);
+
+    mds_upload_host_t *host;
+    mds_upload_handle_t *handle = handle_acquire(uploader, uri, &host);
+    if (handle == NULL) {
+        STAT_ADD(uploader, upload_failures, 1);
         return -ENOMEM;
     }
-    memcpy(header_name, auth_header, header_name_len);
-    header_name[header_name_len] = '\0';
 
-    const char *header_value = colon + 1;
+    /* Compress the body if enabled and worthwhile */
+    mds_upload_encoding_t encoding = (mds_upload_encoding_t)atomic_load(&uploader->encoding);
+    const uint8_t *body = chunk_data;
+    size_t body_len = chunk_len;
 
-    /* Build full header string for curl */
-    size_t full_header_len = strlen(header_name) + 2 + strlen(header_value) + 1; /* name + ": " + value + \0 */
-    char *full_header = malloc(full_header_len);
-    if (full_header == NULL) {
-        free(header_name);
-        uploader->stats.upload_failures++;
+    if (encoding != MDS_UPLOAD_ENCODING_NONE &&
+        chunk_len >= atomic_load(&uploader->compression_min_size) &&
+        chunk_len <= UINT32_MAX) {
+        size_t compressed_len = compress_body(handle, encoding,
+                                              atomic_load(&uploader->compression_level),
+                                              chunk_data, chunk_len);
+        if (compressed_len > 0) {
+            body = handle->zbuf;
+            body_len = compressed_len;
+        }
+    }
+    if (body == chunk_data) {
+        encoding = MDS_UPLOAD_ENCODING_NONE;
+    }
+
+    struct curl_slist *headers = header_cache_get(handle, auth_header, encoding);
+    if (headers == NULL) {
+        handle_release(uploader, handle, host);
+        STAT_ADD(uploader, upload_failures, 1);
         return -ENOMEM;
     }
-    snprintf(full_header, full_header_len, "%s: %s", header_name, header_value);
 
-    /* Set headers */
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, full_header);
-    headers = curl_slist_append(headers, "Content-Type: application/octet-stream");
+    CURL *curl = handle->curl;
+
+    /* Set URL */
+    curl_easy_setopt(curl, CURLOPT_URL, uri);
+
+    /* Set POST method (clears a HEAD left by mds_uploader_prewarm()) */
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+
+    /* Set POST data */
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body_len);
 
-    curl_easy_setopt(uploader->curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
     /* Set timeout */
-    curl_easy_setopt(uploader->curl, CURLOPT_TIMEOUT_MS, uploader->timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, atomic_load(&uploader->timeout_ms));
 
     /* Set verbose if enabled */
-    if (uploader->verbose) {
-        curl_easy_setopt(uploader->curl, CURLOPT_VERBOSE, 1L);
-    }
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, verbose ? 1L : 0L);
 
     /* Perform the request */
-    res = curl_easy_perform(uploader->curl);
+    res = curl_easy_perform(curl);
 
     /* Get HTTP status code */
     long http_code = 0;
-    curl_easy_getinfo(uploader->curl, CURLINFO_RESPONSE_CODE, &http_code);
-    uploader->stats.last_http_status = http_code;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    atomic_store_explicit(&uploader->counters.last_http_status, http_code, memory_order_relaxed);
 
-    /* Clean up headers */
-    curl_slist_free_all(headers);
-    free(full_header);
-    free(header_name);
+    /* Timing of requests that reached the server */
+    histogram_record(&uploader->request_bytes, body_len);
+    if (res == CURLE_OK) {
+        curl_off_t total_us = 0;
+        curl_off_t connect_us = 0;
+        curl_off_t appconnect_us = 0;
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_us);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect_us);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect_us);
+
+        histogram_record(&uploader->latency_us, (uint64_t)total_us);
+
+        /* Zero on a reused connection or plain HTTP */
+        if (appconnect_us > 0 && appconnect_us >= connect_us) {
+            histogram_record(&uploader->tls_handshake_us, (uint64_t)(appconnect_us - connect_us));
+        }
+    }
+
+    /* Retry-After, in either delta-seconds or HTTP-date form */
+    curl_off_t retry_after = 0;
+    if (retry_after_ms != NULL &&
+        curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after) == CURLE_OK &&
+        retry_after > 0) {
+        *retry_after_ms = (long)retry_after * 1000;
+    }
+
+    handle_release(uploader, handle, host);
 
     /* Check result */
     if (res != CURLE_OK) {
         fprintf(stderr, "Upload failed: %s\n", curl_easy_strerror(res));
-        uploader->stats.upload_failures++;
-        return -EIO;
+        STAT_ADD(uploader, upload_failures, 1);
+        return -EAGAIN;
     }
 
     /* Check HTTP status */
     if (http_code < 200 || http_code >= 300) {
         fprintf(stderr, "Upload failed with HTTP status %ld\n", http_code);
-        uploader->stats.upload_failures++;
+        STAT_ADD(uploader, upload_failures, 1);
+        if (http_code == 408 || http_code == 429 || http_code >= 500) {
+            return -EAGAIN;
+        }
         return -EIO;
     }
 
     /* Success - update stats */
-    uploader->stats.chunks_uploaded++;
-    uploader->stats.bytes_uploaded += chunk_len;
+    STAT_ADD(uploader, chunks_uploaded, 1);
+    STAT_ADD(uploader, bytes_uploaded, chunk_len);
+    if (body != chunk_data) {
+        STAT_ADD(uploader, chunks_compressed, 1);
+        STAT_ADD(uploader, bytes_saved, chunk_len - body_len);
+    }
 
-    if (uploader->verbose) {
+    if (verbose) {
         printf("Uploaded chunk: %zu bytes, HTTP %ld\n", chunk_len, http_code);
     }
 
     return 0;
 }
 
+/* Append a chunk to the spool; called with lock held */
+static int spool_chunk(mds_uploader_t *uploader,
+                       const char *uri,
+                       const char *auth_header,
+                       const uint8_t *chunk_data,
+                       size_t chunk_len) {
+    int ret = mds_spool_append(uploader->spool, uri, auth_header, chunk_data, chunk_len);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to spool chunk: %d\n", ret);
+        STAT_ADD(uploader, spool_failures, 1);
+        return -EIO;
+    }
+
+    STAT_ADD(uploader, chunks_spooled, 1);
+    return 0;
+}
+
+/*
+ * Hold off spool drains after a transient failure: by the retry policy's
+ * backoff if one is set, otherwise a fixed interval. Called with lock held.
+ */
+static void spool_backoff(mds_uploader_t *uploader, long retry_after_ms) {
+    uint64_t delay = MDS_SPOOL_RETRY_INTERVAL_MS;
+
+    uploader->spool_failed_attempts++;
+    if (uploader->retry_policy.max_attempts > 1) {
+        delay = retry_delay_ms(uploader, uploader->spool_failed_attempts, retry_after_ms);
+    }
+    uploader->spool_retry_at_ms = monotonic_ms() + delay;
+}
+
+/*
+ * Upload up to max_chunks spooled chunks, oldest first. Chunks rejected
+ * permanently (e.g. 4xx) are dropped so they cannot block the spool.
+ *
+ * Called with lock held. Only one thread drains at a time; the head record
+ * is copied so the lock can be dropped during the upload. If an append from
+ * another thread evicts the head meanwhile, it is not popped a second time.
+ */
+static int drain_spool(mds_uploader_t *uploader, size_t max_chunks) {
+    int drained = 0;
+
+    if (uploader->spool_draining) {
+        return 0;
+    }
+    uploader->spool_draining = true;
+
+    while ((max_chunks == 0 || (size_t)drained < max_chunks) &&
+           !mds_spool_is_empty(uploader->spool)) {
+        const char *uri;
+        const char *auth_header;
+        const uint8_t *chunk_data;
+        size_t chunk_len;
+
+        int ret = mds_spool_peek(uploader->spool, &uri, &auth_header, &chunk_data, &chunk_len);
+        if (ret < 0) {
+            drained = ret;
+            break;
+        }
+
+        size_t uri_len = strlen(uri) + 1;
+        size_t auth_len = strlen(auth_header) + 1;
+        char *copy = malloc(uri_len + auth_len + chunk_len);
+        if (copy == NULL) {
+            drained = drained > 0 ? drained : -ENOMEM;
+            break;
+        }
+        memcpy(copy, uri, uri_len);
+        memcpy(copy + uri_len, auth_header, auth_len);
+        memcpy(copy + uri_len + auth_len, chunk_data, chunk_len);
+
+        mds_spool_stats_t before;
+        mds_spool_get_stats(uploader->spool, &before);
+
+        long retry_after_ms;
+        pthread_mutex_unlock(&uploader->lock);
+        ret = perform_upload(uploader, copy, copy + uri_len,
+                             (const uint8_t *)copy + uri_len + auth_len, chunk_len,
+                             &retry_after_ms);
+        pthread_mutex_lock(&uploader->lock);
+        free(copy);
+
+        if (ret == -EAGAIN) {
+            spool_backoff(uploader, retry_after_ms);
+            drained = drained > 0 ? drained : -EIO;
+            break;
+        }
+
+        uploader->spool_failed_attempts = 0;
+        if (ret == 0) {
+            STAT_ADD(uploader, chunks_drained, 1);
+            drained++;
+        }
+
+        mds_spool_stats_t after;
+        mds_spool_get_stats(uploader->spool, &after);
+        if (after.chunks_evicted == before.chunks_evicted) {
+            ret = mds_spool_pop(uploader->spool);
+            if (ret < 0) {
+                drained = ret;
+                break;
+            }
+        }
+    }
+
+    uploader->spool_draining = false;
+    return drained;
+}
+
+/* ============================================================================
+ * Retry Scheduling
+ *
+ * All functions in this section are called with lock held.
+ * ========================================================================== */
+
+static uint64_t next_random(mds_uploader_t *uploader) {
+    /* xorshift64: only used for backoff jitter */
+    uint64_t x = uploader->rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    uploader->rng_state = x;
+    return x;
+}
+
+static uint64_t retry_delay_ms(mds_uploader_t *uploader, uint32_t attempts, long retry_after_ms) {
+    /* Capped so a server can't park chunks in memory for hours */
+    if (retry_after_ms >= 0) {
+        return (uint64_t)retry_after_ms < uploader->retry_policy.max_delay_ms
+                   ? (uint64_t)retry_after_ms
+                   : uploader->retry_policy.max_delay_ms;
+    }
+
+    uint32_t shift = attempts > 1 ? attempts - 1 : 0;
+    uint64_t delay = (uint64_t)uploader->retry_policy.base_delay_ms << (shift < 32 ? shift : 32);
+    if (delay > uploader->retry_policy.max_delay_ms) {
+        delay = uploader->retry_policy.max_delay_ms;
+    }
+
+    return delay / 2 + next_random(uploader) % (delay / 2 + 1);
+}
+
+static void retry_ready_push(mds_uploader_t *uploader, mds_retry_entry_t *entry) {
+    entry->next = NULL;
+    *uploader->retry_ready_tail = entry;
+    uploader->retry_ready_tail = &entry->next;
+}
+
+/* Put an entry on the wheel, or straight on the ready list if already due */
+static void retry_schedule(mds_uploader_t *uploader, mds_retry_entry_t *entry,
+                           uint64_t now, long retry_after_ms) {
+    entry->due_ms = now + retry_delay_ms(uploader, entry->attempts, retry_after_ms);
+
+    uint64_t due_tick = entry->due_ms / MDS_RETRY_WHEEL_TICK_MS;
+    if (due_tick <= uploader->retry_tick) {
+        retry_ready_push(uploader, entry);
+        return;
+    }
+
+    size_t slot = due_tick % MDS_RETRY_WHEEL_SLOTS;
+    entry->next = uploader->retry_wheel[slot];
+    uploader->retry_wheel[slot] = entry;
+}
+
+/* Move entries whose time has come from the wheel to the ready list */
+static void retry_wheel_advance(mds_uploader_t *uploader, uint64_t now) {
+    uint64_t now_tick = now / MDS_RETRY_WHEEL_TICK_MS;
+    if (now_tick <= uploader->retry_tick) {
+        return;
+    }
+
+    uint64_t ticks = now_tick - uploader->retry_tick;
+    if (ticks > MDS_RETRY_WHEEL_SLOTS) {
+        ticks = MDS_RETRY_WHEEL_SLOTS;
+    }
+
+    for (uint64_t i = 1; i <= ticks; i++) {
+        mds_retry_entry_t **link =
+            &uploader->retry_wheel[(uploader->retry_tick + i) % MDS_RETRY_WHEEL_SLOTS];
+
+        while (*link != NULL) {
+            mds_retry_entry_t *entry = *link;
+            if (entry->due_ms / MDS_RETRY_WHEEL_TICK_MS <= now_tick) {
+                *link = entry->next;
+                retry_ready_push(uploader, entry);
+            } else {
+                link = &entry->next;  /* Due in a later revolution */
+            }
+        }
+    }
+
+    uploader->retry_tick = now_tick;
+}
+
+/* Queue a copy of a transiently failed chunk for its first retry */
+static int retry_enqueue(mds_uploader_t *uploader,
+                         const char *uri,
+                         const char *auth_header,
+                         const uint8_t *chunk_data,
+                         size_t chunk_len,
+                         long retry_after_ms) {
+    if (uploader->retry_policy.max_attempts <= 1 ||
+        uploader->retries_pending >= uploader->retry_policy.max_pending) {
+        return -ENOSPC;
+    }
+
+    size_t uri_len = strlen(uri) + 1;
+    size_t auth_len = strlen(auth_header) + 1;
+    mds_retry_entry_t *entry = malloc(sizeof(*entry) + chunk_len + uri_len + auth_len);
+    if (entry == NULL) {
+        return -ENOMEM;
+    }
+
+    char *strings = (char *)entry->chunk_data + chunk_len;
+    memcpy(entry->chunk_data, chunk_data, chunk_len);
+    memcpy(strings, uri, uri_len);
+    memcpy(strings + uri_len, auth_header, auth_len);
+    entry->uri = strings;
+    entry->auth_header = strings + uri_len;
+    entry->chunk_len = chunk_len;
+    entry->attempts = 1;
+
+    retry_schedule(uploader, entry, monotonic_ms(), retry_after_ms);
+    uploader->retries_pending++;
+    return 0;
+}
+
+/*
+ * Handle a chunk that failed transiently. With a spool it is written to disk
+ * before being acknowledged, so a gateway crash can't lose it, and retried
+ * from there; otherwise it is queued for an in-memory retry.
+ */
+static int defer_chunk(mds_uploader_t *uploader,
+                       const char *uri,
+                       const char *auth_header,
+                       const uint8_t *chunk_data,
+                       size_t chunk_len,
+                       long retry_after_ms) {
+    if (uploader->spool != NULL) {
+        spool_backoff(uploader, retry_after_ms);
+        return spool_chunk(uploader, uri, auth_header, chunk_data, chunk_len);
+    }
+
+    if (retry_enqueue(uploader, uri, auth_header, chunk_data, chunk_len, retry_after_ms) == 0) {
+        return 0;
+    }
+
+    return -EIO;
+}
+
+static uint32_t device_key(const char *uri) {
+    /* FNV-1a; the data URI identifies the device */
+    uint32_t hash = 2166136261u;
+    while (*uri != '\0') {
+        hash = (hash ^ (uint8_t)*uri++) * 16777619u;
+    }
+    return hash;
+}
+
+static bool key_in(const uint32_t *keys, size_t count, uint32_t key) {
+    for (size_t i = 0; i < count; i++) {
+        if (keys[i] == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Attempt up to MDS_RETRY_BATCH due retries. Each round takes at most one
+ * chunk per device, so a device with a long backlog cannot starve others,
+ * and a device whose retry fails is skipped for the rest of the call.
+ * The lock is dropped around each upload; the entry being retried is off
+ * every list meanwhile, so other threads cannot touch it.
+ */
+static int run_retries(mds_uploader_t *uploader) {
+    uint32_t blocked[MDS_RETRY_BATCH];
+    size_t blocked_count = 0;
+    size_t attempts = 0;
+    int succeeded = 0;
+
+    retry_wheel_advance(uploader, monotonic_ms());
+
+    while (uploader->retry_ready != NULL && attempts < MDS_RETRY_BATCH) {
+        uint32_t served[MDS_RETRY_BATCH];
+        size_t served_count = 0;
+
+        while (attempts < MDS_RETRY_BATCH) {
+            /* Rescan from the front; the list may change while unlocked */
+            mds_retry_entry_t **link = &uploader->retry_ready;
+            while (*link != NULL) {
+                uint32_t key = device_key((*link)->uri);
+                if (!key_in(served, served_count, key) && !key_in(blocked, blocked_count, key)) {
+                    break;
+                }
+                link = &(*link)->next;
+            }
+
+            if (*link == NULL) {
+                break;
+            }
+
+            /* Unlink from the ready list */
+            mds_retry_entry_t *entry = *link;
+            *link = entry->next;
+            if (*link == NULL) {
+                uploader->retry_ready_tail = link;
+            }
+
+            uint32_t key = device_key(entry->uri);
+            served[served_count++] = key;
+            attempts++;
+            STAT_ADD(uploader, retries, 1);
+
+            long retry_after_ms;
+            pthread_mutex_unlock(&uploader->lock);
+            int ret = perform_upload(uploader, entry->uri, entry->auth_header,
+                                     entry->chunk_data, entry->chunk_len, &retry_after_ms);
+            pthread_mutex_lock(&uploader->lock);
+
+            if (ret == -EAGAIN) {
+                blocked[blocked_count++] = key;
+                if (++entry->attempts < uploader->retry_policy.max_attempts) {
+                    retry_schedule(uploader, entry, monotonic_ms(), retry_after_ms);
+                    continue;
+                }
+
+                STAT_ADD(uploader, retries_exhausted, 1);
+                if (uploader->spool != NULL) {
+                    spool_chunk(uploader, entry->uri, entry->auth_header,
+                                entry->chunk_data, entry->chunk_len);
+                }
+            } else if (ret == 0) {
+                succeeded++;
+            }
+
+            uploader->retries_pending--;
+            free(entry);
+        }
+
+        if (served_count == 0) {
+            break;  /* Only blocked devices left */
+        }
+    }
+
+    return succeeded;
+}
+
+/* Free all pending retries, persisting them first if a spool is attached */
+static void retry_release_all(mds_uploader_t *uploader) {
+    mds_retry_entry_t *lists[MDS_RETRY_WHEEL_SLOTS + 1];
+    memcpy(lists, uploader->retry_wheel, sizeof(uploader->retry_wheel));
+    lists[MDS_RETRY_WHEEL_SLOTS] = uploader->retry_ready;
+
+    for (size_t i = 0; i <= MDS_RETRY_WHEEL_SLOTS; i++) {
+        mds_retry_entry_t *entry = lists[i];
+        while (entry != NULL) {
+            mds_retry_entry_t *next = entry->next;
+            if (uploader->spool != NULL) {
+                spool_chunk(uploader, entry->uri, entry->auth_header,
+                            entry->chunk_data, entry->chunk_len);
+            }
+            free(entry);
+            entry = next;
+        }
+    }
+
+    memset(uploader->retry_wheel, 0, sizeof(uploader->retry_wheel));
+    uploader->retry_ready = NULL;
+    uploader->retry_ready_tail = &uploader->retry_ready;
+    uploader->retries_pending = 0;
+}
+
+/* ============================================================================
+ * Duplicate Suppression
+ * ========================================================================== */
+
+static uint64_t fingerprint_mix(uint64_t hash) {
+    /* MurmurHash3 finalizer */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* Fast non-cryptographic 64-bit hash of a chunk, eight bytes per step */
+static uint64_t chunk_fingerprint(const uint8_t *data, size_t len) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ ((uint64_t)len * 0xc2b2ae3d27d4eb4full);
+    uint64_t word;
+
+    while (len >= sizeof(word)) {
+        memcpy(&word, data, sizeof(word));
+        hash ^= word * 0x87c37b91114253d5ull;
+        hash = ((hash << 31) | (hash >> 33)) * 0x4cf5ad432745937full;
+        data += sizeof(word);
+        len -= sizeof(word);
+    }
+
+    if (len > 0) {
+        word = 0;
+        memcpy(&word, data, len);
+        hash ^= word * 0x87c37b91114253d5ull;
+    }
+
+    return fingerprint_mix(hash);
+}
+
+static void dedup_clear(mds_uploader_t *uploader) {
+    while (uploader->dedup_devices != NULL) {
+        mds_dedup_device_t *device = uploader->dedup_devices;
+        uploader->dedup_devices = device->next;
+        free(device->uri);
+        free(device);
+    }
+    uploader->dedup_devices_count = 0;
+}
+
+/*
+ * Find the fingerprint ring for a device and move it to the front, adding it
+ * (and forgetting the least recently seen device if at the limit) when
+ * create is set. Called with lock held.
+ */
+static mds_dedup_device_t *dedup_device_get(mds_uploader_t *uploader, const char *uri, bool create) {
+    uint32_t key = device_key(uri);
+    mds_dedup_device_t **link = &uploader->dedup_devices;
+    mds_dedup_device_t **last = link;
+
+    while (*link != NULL) {
+        /* The hash only skips mismatches; colliding devices keep separate rings */
+        if ((*link)->key == key && strcmp((*link)->uri, uri) == 0) {
+            mds_dedup_device_t *device = *link;
+            *link = device->next;
+            device->next = uploader->dedup_devices;
+            uploader->dedup_devices = device;
+            return device;
+        }
+        last = link;
+        link = &(*link)->next;
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    char *uri_copy = strdup(uri);
+    if (uri_copy == NULL) {
+        return NULL;
+    }
+
+    mds_dedup_device_t *device;
+    if (uploader->dedup_devices_count >= MDS_DEDUP_MAX_DEVICES) {
+        /* Reuse the least recently seen device's ring */
+        device = *last;
+        *last = NULL;
+        free(device->uri);
+    } else {
+        device = malloc(sizeof(*device) + uploader->dedup_history * sizeof(uint64_t));
+        if (device == NULL) {
+            free(uri_copy);
+            return NULL;
+        }
+        uploader->dedup_devices_count++;
+    }
+
+    device->key = key;
+    device->uri = uri_copy;
+    device->count = 0;
+    device->head = 0;
+    device->next = uploader->dedup_devices;
+    uploader->dedup_devices = device;
+    return device;
+}
+
+/* Check whether a chunk repeats a recent one; called with lock held */
+static bool dedup_is_duplicate(mds_uploader_t *uploader, const char *uri, uint64_t fingerprint) {
+    mds_dedup_device_t *device = dedup_device_get(uploader, uri, false);
+    if (device == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < device->count; i++) {
+        if (device->fingerprints[i] == fingerprint) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Remember an accepted chunk; called with lock held */
+static void dedup_record(mds_uploader_t *uploader, const char *uri, uint64_t fingerprint) {
+    mds_dedup_device_t *device = dedup_device_get(uploader, uri, true);
+    if (device == NULL) {
+        return;
+    }
+
+    device->fingerprints[device->head] = fingerprint;
+    device->head = (device->head + 1) % uploader->dedup_history;
+    if (device->count < uploader->dedup_history) {
+        device->count++;
+    }
+}
+
+/* ============================================================================
+ * Upload Callback
+ * ========================================================================== */
+
+int mds_uploader_callback(const char *uri,
+                          const char *auth_header,
+                          const uint8_t *chunk_data,
+                          size_t chunk_len,
+                          void *user_data) {
+    if (uri == NULL || auth_header == NULL || chunk_data == NULL || user_data == NULL) {
+        return -EINVAL;
+    }
+
+    mds_uploader_t *uploader = (mds_uploader_t *)user_data;
+    bool dedup = false;
+    uint64_t fingerprint = 0;
+    int ret;
+
+    pthread_mutex_lock(&uploader->lock);
+
+    if (uploader->dedup_history > 0) {
+        dedup = true;
+        fingerprint = chunk_fingerprint(chunk_data, chunk_len);
+        if (dedup_is_duplicate(uploader, uri, fingerprint)) {
+            pthread_mutex_unlock(&uploader->lock);
+            STAT_ADD(uploader, duplicates_suppressed, 1);
+            return 0;
+        }
+    }
+
+    if (uploader->spool != NULL && !mds_spool_is_empty(uploader->spool)) {
+        /* Queue behind older spooled chunks so the backend sees them in order;
+           mds_uploader_poll() drains them */
+        ret = spool_chunk(uploader, uri, auth_header, chunk_data, chunk_len);
+    } else {
+        long retry_after_ms;
+        pthread_mutex_unlock(&uploader->lock);
+        ret = perform_upload(uploader, uri, auth_header, chunk_data, chunk_len, &retry_after_ms);
+        pthread_mutex_lock(&uploader->lock);
+
+        if (ret == -EAGAIN) {
+            ret = defer_chunk(uploader, uri, auth_header, chunk_data, chunk_len, retry_after_ms);
+        }
+    }
+
+    /* Uploaded, spooled or queued for retry: a re-send would be a duplicate */
+    if (ret == 0 && dedup && uploader->dedup_history > 0) {
+        dedup_record(uploader, uri, fingerprint);
+    }
+
+    pthread_mutex_unlock(&uploader->lock);
+    return ret;
+}
+
+int mds_uploader_prewarm(mds_uploader_t *uploader, const char *uri) {
+    if (uploader == NULL || uri == NULL) {
+        return -EINVAL;
+    }
+
+    mds_upload_host_t *host;
+    mds_upload_handle_t *handle = handle_acquire(uploader, uri, &host);
+    if (handle == NULL) {
+        return -ENOMEM;
+    }
+
+    /*
+     * A HEAD request completes DNS, TCP and TLS and leaves the connection in
+     * the shared pool; the response status is irrelevant.
+     */
+    bool verbose = atomic_load(&uploader->verbose);
+    curl_easy_setopt(handle->curl, CURLOPT_URL, uri);
+    curl_easy_setopt(handle->curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(handle->curl, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(handle->curl, CURLOPT_TIMEOUT_MS, atomic_load(&uploader->timeout_ms));
+    curl_easy_setopt(handle->curl, CURLOPT_VERBOSE, verbose ? 1L : 0L);
+
+    CURLcode res = curl_easy_perform(handle->curl);
+    handle_release(uploader, handle, host);
+
+    if (res != CURLE_OK) {
+        if (verbose) {
+            fprintf(stderr, "Pre-warm failed: %s\n", curl_easy_strerror(res));
+        }
+        return -EIO;
+    }
+
+    return 0;
+}
+
+int mds_uploader_set_retry_policy(mds_uploader_t *uploader,
+                                  const mds_retry_policy_t *policy) {
+    if (uploader == NULL || policy == NULL || policy->max_attempts == 0) {
+        return -EINVAL;
+    }
+
+    if (policy->max_attempts > 1 &&
+        (policy->max_pending == 0 || policy->max_delay_ms < policy->base_delay_ms)) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    uploader->retry_policy = *policy;
+    pthread_mutex_unlock(&uploader->lock);
+    return 0;
+}
+
+int mds_uploader_poll(mds_uploader_t *uploader) {
+    if (uploader == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    int ret = run_retries(uploader);
+
+    if (uploader->spool != NULL && !mds_spool_is_empty(uploader->spool) &&
+        monotonic_ms() >= uploader->spool_retry_at_ms) {
+        int drained = drain_spool(uploader, MDS_SPOOL_DRAIN_BATCH);
+        if (drained > 0) {
+            ret += drained;
+        }
+    }
+
+    pthread_mutex_unlock(&uploader->lock);
+    return ret;
+}
+
+int mds_uploader_set_spool(mds_uploader_t *uploader, mds_spool_t *spool) {
+    if (uploader == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    uploader->spool = spool;
+    uploader->spool_retry_at_ms = 0;
+    uploader->spool_failed_attempts = 0;
+    pthread_mutex_unlock(&uploader->lock);
+    return 0;
+}
+
+int mds_uploader_drain_spool(mds_uploader_t *uploader, size_t max_chunks) {
+    if (uploader == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    int ret = (uploader->spool != NULL) ? drain_spool(uploader, max_chunks) : -EINVAL;
+    pthread_mutex_unlock(&uploader->lock);
+    return ret;
+}
+
 /* ============================================================================
  * Statistics
  * ========================================================================== */
 
+/* Read (and optionally clear) all statistics */
+static void stats_snapshot(mds_uploader_t *uploader, mds_upload_stats_t *stats, bool reset) {
+#define COUNTER_READ(field) \
+    (reset ? atomic_exchange_explicit(&uploader->counters.field, 0, memory_order_relaxed) \
+           : atomic_load_explicit(&uploader->counters.field, memory_order_relaxed))
+
+    stats->chunks_uploaded = COUNTER_READ(chunks_uploaded);
+    stats->bytes_uploaded = COUNTER_READ(bytes_uploaded);
+    stats->upload_failures = COUNTER_READ(upload_failures);
+    stats->last_http_status = COUNTER_READ(last_http_status);
+    stats->chunks_spooled = COUNTER_READ(chunks_spooled);
+    stats->chunks_drained = COUNTER_READ(chunks_drained);
+    stats->spool_failures = COUNTER_READ(spool_failures);
+    stats->retries = COUNTER_READ(retries);
+    stats->retries_exhausted = COUNTER_READ(retries_exhausted);
+    stats->chunks_compressed = COUNTER_READ(chunks_compressed);
+    stats->bytes_saved = COUNTER_READ(bytes_saved);
+    stats->rate_limited = COUNTER_READ(rate_limited);
+    stats->rate_limit_delay_ms = COUNTER_READ(rate_limit_delay_ms);
+    stats->duplicates_suppressed = COUNTER_READ(duplicates_suppressed);
+
+#undef COUNTER_READ
+
+    /* Pending retries are state, not a counter */
+    pthread_mutex_lock(&uploader->lock);
+    stats->retries_pending = uploader->retries_pending;
+    stats->rate_limit_waiting = uploader->rate_waiting;
+    stats->rate_limit_buckets = uploader->rate_buckets_count;
+    pthread_mutex_unlock(&uploader->lock);
+
+    histogram_snapshot(&uploader->latency_us, &stats->latency_us, reset);
+    histogram_snapshot(&uploader->tls_handshake_us, &stats->tls_handshake_us, reset);
+    histogram_snapshot(&uploader->request_bytes, &stats->request_bytes, reset);
+}
+
 int mds_uploader_get_stats(mds_uploader_t *uploader,
                            mds_upload_stats_t *stats) {
     if (uploader == NULL || stats == NULL) {
         return -EINVAL;
     }
 
-    *stats = uploader->stats;
+    stats_snapshot(uploader, stats, false);
+    return 0;
+}
+
+int mds_uploader_take_stats(mds_uploader_t *uploader,
+                            mds_upload_stats_t *stats) {
+    if (uploader == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    stats_snapshot(uploader, stats, true);
     return 0;
 }
 
@@ -191,7 +1638,8 @@ int mds_uploader_reset_stats(mds_uploader_t *uploader) {
         return -EINVAL;
     }
 
-    memset(&uploader->stats, 0, sizeof(uploader->stats));
+    mds_upload_stats_t discard;
+    stats_snapshot(uploader, &discard, true);
     return 0;
 }
 
@@ -205,7 +1653,7 @@ int mds_uploader_set_timeout(mds_uploader_t *uploader,
         return -EINVAL;
     }
 
-    uploader->timeout_ms = timeout_ms;
+    atomic_store(&uploader->timeout_ms, timeout_ms);
     return 0;
 }
 
@@ -215,6 +1663,69 @@ int mds_uploader_set_verbose(mds_uploader_t *uploader,
         return -EINVAL;
     }
 
-    uploader->verbose = verbose;
+    atomic_store(&uploader->verbose, verbose);
+    return 0;
+}
+
+int mds_uploader_set_compression(mds_uploader_t *uploader,
+                                 mds_upload_encoding_t encoding,
+                                 int level,
+                                 size_t min_size) {
+    if (uploader == NULL || (unsigned int)encoding >= MDS_UPLOAD_ENCODING_COUNT ||
+        level < 1 || level > 9) {
+        return -EINVAL;
+    }
+
+    atomic_store(&uploader->compression_level, level);
+    atomic_store(&uploader->compression_min_size, min_size);
+    atomic_store(&uploader->encoding, (int)encoding);
+    return 0;
+}
+
+int mds_uploader_set_rate_limit(mds_uploader_t *uploader,
+                                double rate,
+                                uint32_t burst) {
+    if (uploader == NULL || rate < 0 || (rate > 0 && burst == 0)) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    uploader->rate_limit = rate;
+    uploader->rate_burst = burst;
+    for (mds_rate_bucket_t *bucket = uploader->rate_buckets; bucket != NULL;
+         bucket = bucket->next) {
+        if (bucket->tokens > burst) {
+            bucket->tokens = burst;
+        }
+    }
+    pthread_mutex_unlock(&uploader->lock);
+    return 0;
+}
+
+int mds_uploader_set_dedup(mds_uploader_t *uploader, size_t history) {
+    if (uploader == NULL || history > MDS_DEDUP_MAX_HISTORY) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    if (history != uploader->dedup_history) {
+        /* Rings are sized for the old history */
+        dedup_clear(uploader);
+        uploader->dedup_history = history;
+    }
+    pthread_mutex_unlock(&uploader->lock);
+    return 0;
+}
+
+int mds_uploader_set_max_connections(mds_uploader_t *uploader,
+                                     size_t max_per_host) {
+    if (uploader == NULL || max_per_host == 0) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+    uploader->max_conns_per_host = max_per_host;
+    pthread_cond_broadcast(&uploader->host_available);
+    pthread_mutex_unlock(&uploader->lock);
     return 0;
 }
@@ -4,49 +4,147 @@
  */
 
 #include "memfault_hid/memfault_hid.h"
+#include "memfault_hid_descriptor.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <wchar.h>
 #include <hidapi.h>
 
+/* hid_get_report_descriptor() appeared in hidapi 0.14 */
+#if defined(HID_API_VERSION) && defined(HID_API_MAKE_VERSION)
+#if HID_API_VERSION >= HID_API_MAKE_VERSION(0, 14, 0)
+#define MEMFAULT_HID_HAVE_REPORT_DESCRIPTOR 1
+#endif
+#endif
+
+#ifndef HID_API_MAX_REPORT_DESCRIPTOR_SIZE
+#define HID_API_MAX_REPORT_DESCRIPTOR_SIZE 4096
+#endif
+
+/* Report types indexed from 0 in the size tables */
+#define REPORT_TYPE_COUNT   3
+
+/* Clock for write deadlines; macOS can't set a condition variable's clock */
+#ifdef __APPLE__
+#define WRITE_CLOCK         CLOCK_REALTIME
+#else
+#define WRITE_CLOCK         CLOCK_MONOTONIC
+#endif
+
 /* Device structure */
 struct memfault_hid_device {
     hid_device *handle;
     memfault_hid_device_info_t info;
-    memfault_hid_report_filter_t filter;
     bool nonblocking;
+
+    /* Report filter: bit n of filter_bitmap set if Report ID n is allowed */
+    bool filter_enabled;
+    uint32_t filter_bitmap[256 / 32];
+    uint8_t filter_ids[256];        /* Allowed IDs in the order given, for get */
+    size_t filter_num_ids;
+
+    /* Report sizes in bytes (excluding Report ID) declared by the report
+       descriptor, by type - 1 and Report ID; 0 if not declared */
+    bool descriptor_valid;
+    uint16_t report_sizes[REPORT_TYPE_COUNT][256];
+    size_t max_report_size[REPORT_TYPE_COUNT];  /* At least MEMFAULT_HID_MAX_REPORT_SIZE */
+
+    /* Report ID + largest input report, also behind memfault_hid_read_report_view() */
+    uint8_t *rx_buffer;
+    size_t rx_buffer_size;
+
+    /* Report ID + largest output or feature report */
+    uint8_t *tx_buffer;
+    size_t tx_buffer_size;
+
+    /* Bounded writes: hid_write() runs on a writer thread, started on the
+       first write with a timeout, so the caller can give up on a wedged device */
+    pthread_mutex_t write_lock;
+    pthread_cond_t write_cond;
+    pthread_t writer;
+    bool writer_running;
+    bool writer_stop;
+    bool write_pending;             /* write_buffer is being written */
+    int write_result;               /* hid_write() result of the last write */
+    uint8_t *write_buffer;          /* Report ID + output report, tx_buffer_size */
+    size_t write_len;
 };
 
-/* Library initialization state */
-static bool g_initialized = false;
+/* Library initialization state: references taken by memfault_hid_init().
+   g_lock serializes reference transitions and every hidapi call that touches
+   library-wide state (init/exit, enumeration, open, close), which not all
+   hidapi backends make thread-safe. */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint g_init_count;
+
+static bool is_initialized(void) {
+    return atomic_load(&g_init_count) > 0;
+}
 
 /* ============================================================================
  * Library Initialization
  * ========================================================================== */
 
 int memfault_hid_init(void) {
-    if (g_initialized) {
-        return MEMFAULT_HID_SUCCESS;
-    }
+    int ret = MEMFAULT_HID_SUCCESS;
 
-    if (hid_init() != 0) {
-        return MEMFAULT_HID_ERROR_UNKNOWN;
+    pthread_mutex_lock(&g_lock);
+    if (atomic_load(&g_init_count) == 0 && hid_init() != 0) {
+        ret = MEMFAULT_HID_ERROR_UNKNOWN;
+    } else {
+        atomic_fetch_add(&g_init_count, 1);
     }
+    pthread_mutex_unlock(&g_lock);
 
-    g_initialized = true;
-    return MEMFAULT_HID_SUCCESS;
+    return ret;
 }
 
 int memfault_hid_exit(void) {
-    if (!g_initialized) {
-        return MEMFAULT_HID_SUCCESS;
+    int ret = MEMFAULT_HID_SUCCESS;
+
+    pthread_mutex_lock(&g_lock);
+    unsigned int count = atomic_load(&g_init_count);
+    if (count == 1 && hid_exit() != 0) {
+        ret = MEMFAULT_HID_ERROR_UNKNOWN;
+    } else if (count > 0) {
+        atomic_fetch_sub(&g_init_count, 1);
     }
+    pthread_mutex_unlock(&g_lock);
 
-    if (hid_exit() != 0) {
-        return MEMFAULT_HID_ERROR_UNKNOWN;
-    }
+    return ret;
+}
 
-    g_initialized = false;
-    return MEMFAULT_HID_SUCCESS;
+/* hidapi calls that touch library-wide state, under g_lock */
+static struct hid_device_info *locked_hid_enumerate(uint16_t vendor_id, uint16_t product_id) {
+    pthread_mutex_lock(&g_lock);
+    struct hid_device_info *dev_list = hid_enumerate(vendor_id, product_id);
+    pthread_mutex_unlock(&g_lock);
+    return dev_list;
+}
+
+static hid_device *locked_hid_open(uint16_t vendor_id, uint16_t product_id,
+                                   const wchar_t *serial_number) {
+    pthread_mutex_lock(&g_lock);
+    hid_device *handle = hid_open(vendor_id, product_id, serial_number);
+    pthread_mutex_unlock(&g_lock);
+    return handle;
+}
+
+static hid_device *locked_hid_open_path(const char *path) {
+    pthread_mutex_lock(&g_lock);
+    hid_device *handle = hid_open_path(path);
+    pthread_mutex_unlock(&g_lock);
+    return handle;
+}
+
+static void locked_hid_close(hid_device *handle) {
+    pthread_mutex_lock(&g_lock);
+    hid_close(handle);
+    pthread_mutex_unlock(&g_lock);
 }
 
 /* ============================================================================
@@ -57,7 +155,7 @@ int memfault_hid_enumerate(uint16_t vendor_id,
                            uint16_t product_id,
                            memfault_hid_device_info_t **devices,
                            size_t *num_devices) {
-    if (!g_initialized) {
+    if (!is_initialized()) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
@@ -65,7 +163,7 @@ int memfault_hid_enumerate(uint16_t vendor_id,
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    struct hid_device_info *dev_list = hid_enumerate(vendor_id, product_id);
+    struct hid_device_info *dev_list = locked_hid_enumerate(vendor_id, product_id);
     if (dev_list == NULL) {
         *devices = NULL;
         *num_devices = 0;
@@ -126,12 +224,245 @@ void memfault_hid_free_device_list(memfault_hid_device_info_t *devices) {
     free(devices);
 }
 
+static bool enumerate_match(const struct hid_device_info *cur, uint32_t flags) {
+    if (flags & MEMFAULT_HID_ENUMERATE_MDS_ONLY) {
+        return cur->usage_page == MEMFAULT_HID_MDS_USAGE_PAGE &&
+               cur->usage == MEMFAULT_HID_MDS_USAGE;
+    }
+    return true;
+}
+
+static size_t wide_size(const wchar_t *str) {
+    return ((str != NULL) ? wcslen(str) + 1 : 1) * sizeof(wchar_t);
+}
+
+/* Copy a wide string (empty if NULL) into the arena and advance it */
+static const wchar_t *arena_put_wide(uint8_t **arena, const wchar_t *str) {
+    wchar_t *dst = (wchar_t *)*arena;
+    size_t size = wide_size(str);
+
+    if (str != NULL) {
+        memcpy(dst, str, size);
+    } else {
+        dst[0] = L'\0';
+    }
+    *arena += size;
+    return dst;
+}
+
+int memfault_hid_enumerate_compact(uint16_t vendor_id,
+                                   uint16_t product_id,
+                                   uint32_t flags,
+                                   memfault_hid_device_entry_t **devices,
+                                   size_t *num_devices) {
+    if (!is_initialized()) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    if (devices == NULL || num_devices == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    *devices = NULL;
+    *num_devices = 0;
+
+    struct hid_device_info *dev_list = locked_hid_enumerate(vendor_id, product_id);
+    if (dev_list == NULL) {
+        return MEMFAULT_HID_SUCCESS;
+    }
+
+    /* Size the entries, then the wide strings, then the paths */
+    size_t count = 0;
+    size_t wide_bytes = 0;
+    size_t path_bytes = 0;
+    for (struct hid_device_info *cur = dev_list; cur != NULL; cur = cur->next) {
+        if (!enumerate_match(cur, flags)) {
+            continue;
+        }
+        count++;
+        wide_bytes += wide_size(cur->serial_number) + wide_size(cur->manufacturer_string) +
+                      wide_size(cur->product_string);
+        path_bytes += strlen(cur->path) + 1;
+    }
+
+    if (count == 0) {
+        hid_free_enumeration(dev_list);
+        return MEMFAULT_HID_SUCCESS;
+    }
+
+    /* Entries are pointer-aligned, so the wide strings that follow are too */
+    size_t entries_bytes = count * sizeof(memfault_hid_device_entry_t);
+    memfault_hid_device_entry_t *entries = malloc(entries_bytes + wide_bytes + path_bytes);
+    if (entries == NULL) {
+        hid_free_enumeration(dev_list);
+        return MEMFAULT_HID_ERROR_NO_MEM;
+    }
+
+    uint8_t *wide_arena = (uint8_t *)entries + entries_bytes;
+    char *path_arena = (char *)entries + entries_bytes + wide_bytes;
+    size_t i = 0;
+
+    for (struct hid_device_info *cur = dev_list; cur != NULL; cur = cur->next) {
+        if (!enumerate_match(cur, flags)) {
+            continue;
+        }
+
+        memfault_hid_device_entry_t *entry = &entries[i++];
+        size_t path_len = strlen(cur->path) + 1;
+
+        memcpy(path_arena, cur->path, path_len);
+        entry->path = path_arena;
+        path_arena += path_len;
+
+        entry->serial_number = arena_put_wide(&wide_arena, cur->serial_number);
+        entry->manufacturer = arena_put_wide(&wide_arena, cur->manufacturer_string);
+        entry->product = arena_put_wide(&wide_arena, cur->product_string);
+
+        entry->vendor_id = cur->vendor_id;
+        entry->product_id = cur->product_id;
+        entry->release_number = cur->release_number;
+        entry->usage_page = cur->usage_page;
+        entry->usage = cur->usage;
+        entry->interface_number = cur->interface_number;
+    }
+
+    hid_free_enumeration(dev_list);
+
+    *devices = entries;
+    *num_devices = count;
+    return MEMFAULT_HID_SUCCESS;
+}
+
+void memfault_hid_free_device_entries(memfault_hid_device_entry_t *devices) {
+    free(devices);
+}
+
 /* ============================================================================
  * Device Management
  * ========================================================================== */
 
+/*
+ * Sum the bits of every Input, Output and Feature main item per Report ID.
+ * Only the global items that affect report layout are tracked.
+ */
+static void parse_report_descriptor(memfault_hid_device_t *device,
+                                    const uint8_t *desc, size_t len) {
+    typedef struct {
+        uint32_t report_size;
+        uint32_t report_count;
+        uint8_t report_id;
+    } globals_t;
+
+    uint32_t bits[REPORT_TYPE_COUNT][256];
+    globals_t globals = {0};
+    globals_t stack[4];
+    size_t depth = 0;
+    size_t pos = 0;
+    memfault_hid_item_t item;
+
+    memset(bits, 0, sizeof(bits));
+
+    while (memfault_hid_descriptor_next(desc, len, &pos, &item)) {
+        if (item.type == MEMFAULT_HID_ITEM_GLOBAL) {
+            /* Global items */
+            switch (item.tag) {
+                case 0x7:
+                    globals.report_size = item.value;
+                    break;
+                case 0x8:
+                    globals.report_id = (uint8_t)item.value;
+                    break;
+                case 0x9:
+                    globals.report_count = item.value;
+                    break;
+                case 0xA:
+                    if (depth < sizeof(stack) / sizeof(stack[0])) {
+                        stack[depth++] = globals;
+                    }
+                    break;
+                case 0xB:
+                    if (depth > 0) {
+                        globals = stack[--depth];
+                    }
+                    break;
+                default:
+                    break;
+            }
+        } else if (item.type == MEMFAULT_HID_ITEM_MAIN) {
+            /* Main items: Input (0x8), Output (0x9), Feature (0xB) */
+            int index = (item.tag == 0x8) ? 0 : (item.tag == 0x9) ? 1 : (item.tag == 0xB) ? 2 : -1;
+            if (index >= 0) {
+                uint64_t total = bits[index][globals.report_id] +
+                                 (uint64_t)globals.report_size * globals.report_count;
+                bits[index][globals.report_id] = total > UINT32_MAX ? UINT32_MAX : (uint32_t)total;
+            }
+        }
+    }
+
+    for (size_t t = 0; t < REPORT_TYPE_COUNT; t++) {
+        for (size_t id = 0; id < 256; id++) {
+            uint32_t bytes = (bits[t][id] + 7) / 8;
+            device->report_sizes[t][id] = bytes > UINT16_MAX ? UINT16_MAX : (uint16_t)bytes;
+            if (device->report_sizes[t][id] > device->max_report_size[t]) {
+                device->max_report_size[t] = device->report_sizes[t][id];
+            }
+        }
+    }
+
+    device->descriptor_valid = true;
+}
+
+/* Learn report sizes from the device and allocate buffers to match */
+static int device_setup(memfault_hid_device_t *device) {
+    for (size_t t = 0; t < REPORT_TYPE_COUNT; t++) {
+        device->max_report_size[t] = MEMFAULT_HID_MAX_REPORT_SIZE;
+    }
+
+#ifdef MEMFAULT_HID_HAVE_REPORT_DESCRIPTOR
+    uint8_t *desc = malloc(HID_API_MAX_REPORT_DESCRIPTOR_SIZE);
+    if (desc == NULL) {
+        return MEMFAULT_HID_ERROR_NO_MEM;
+    }
+
+    /* Without a descriptor every report is assumed to fit the default size */
+    int desc_len = hid_get_report_descriptor(device->handle, desc,
+                                             HID_API_MAX_REPORT_DESCRIPTOR_SIZE);
+    if (desc_len > 0) {
+        parse_report_descriptor(device, desc, (size_t)desc_len);
+    }
+    free(desc);
+#endif
+
+    device->rx_buffer_size = device->max_report_size[0] + 1;
+    device->tx_buffer_size = 1 + (device->max_report_size[1] > device->max_report_size[2]
+                                      ? device->max_report_size[1]
+                                      : device->max_report_size[2]);
+
+    device->rx_buffer = malloc(device->rx_buffer_size);
+    device->tx_buffer = malloc(device->tx_buffer_size);
+    device->write_buffer = malloc(device->tx_buffer_size);
+    if (device->rx_buffer == NULL || device->tx_buffer == NULL ||
+        device->write_buffer == NULL) {
+        free(device->rx_buffer);
+        free(device->tx_buffer);
+        free(device->write_buffer);
+        return MEMFAULT_HID_ERROR_NO_MEM;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#ifndef __APPLE__
+    pthread_condattr_setclock(&attr, WRITE_CLOCK);
+#endif
+    pthread_cond_init(&device->write_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&device->write_lock, NULL);
+
+    return MEMFAULT_HID_SUCCESS;
+}
+
 int memfault_hid_open_path(const char *path, memfault_hid_device_t **device) {
-    if (!g_initialized || path == NULL || device == NULL) {
+    if (!is_initialized() || path == NULL || device == NULL) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
@@ -140,17 +471,24 @@ int memfault_hid_open_path(const char *path, memfault_hid_device_t **device) {
         return MEMFAULT_HID_ERROR_NO_MEM;
     }
 
-    dev->handle = hid_open_path(path);
+    dev->handle = locked_hid_open_path(path);
     if (dev->handle == NULL) {
         free(dev);
         return MEMFAULT_HID_ERROR_NOT_FOUND;
     }
 
+    int ret = device_setup(dev);
+    if (ret != MEMFAULT_HID_SUCCESS) {
+        locked_hid_close(dev->handle);
+        free(dev);
+        return ret;
+    }
+
     /* Store device path */
     strncpy(dev->info.path, path, sizeof(dev->info.path) - 1);
 
     dev->nonblocking = false;
-    dev->filter.filter_enabled = false;
+    dev->filter_enabled = false;
 
     *device = dev;
     return MEMFAULT_HID_SUCCESS;
@@ -160,7 +498,7 @@ int memfault_hid_open(uint16_t vendor_id,
                       uint16_t product_id,
                       const wchar_t *serial_number,
                       memfault_hid_device_t **device) {
-    if (!g_initialized || device == NULL) {
+    if (!is_initialized() || device == NULL) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
@@ -169,12 +507,19 @@ int memfault_hid_open(uint16_t vendor_id,
         return MEMFAULT_HID_ERROR_NO_MEM;
     }
 
-    dev->handle = hid_open(vendor_id, product_id, serial_number);
+    dev->handle = locked_hid_open(vendor_id, product_id, serial_number);
     if (dev->handle == NULL) {
         free(dev);
         return MEMFAULT_HID_ERROR_NOT_FOUND;
     }
 
+    int ret = device_setup(dev);
+    if (ret != MEMFAULT_HID_SUCCESS) {
+        locked_hid_close(dev->handle);
+        free(dev);
+        return ret;
+    }
+
     /* Store basic device info */
     dev->info.vendor_id = vendor_id;
     dev->info.product_id = product_id;
@@ -183,7 +528,7 @@ int memfault_hid_open(uint16_t vendor_id,
     }
 
     dev->nonblocking = false;
-    dev->filter.filter_enabled = false;
+    dev->filter_enabled = false;
 
     *device = dev;
     return MEMFAULT_HID_SUCCESS;
@@ -194,14 +539,24 @@ void memfault_hid_close(memfault_hid_device_t *device) {
         return;
     }
 
-    if (device->handle) {
-        hid_close(device->handle);
+    /* Waits for a write still in flight */
+    if (device->writer_running) {
+        pthread_mutex_lock(&device->write_lock);
+        device->writer_stop = true;
+        pthread_cond_broadcast(&device->write_cond);
+        pthread_mutex_unlock(&device->write_lock);
+        pthread_join(device->writer, NULL);
     }
 
-    if (device->filter.report_ids) {
-        free(device->filter.report_ids);
+    if (device->handle) {
+        locked_hid_close(device->handle);
     }
 
+    pthread_cond_destroy(&device->write_cond);
+    pthread_mutex_destroy(&device->write_lock);
+    free(device->rx_buffer);
+    free(device->tx_buffer);
+    free(device->write_buffer);
     free(device);
 }
 
@@ -215,6 +570,38 @@ int memfault_hid_get_device_info(memfault_hid_device_t *device,
     return MEMFAULT_HID_SUCCESS;
 }
 
+static bool report_type_valid(memfault_hid_report_type_t type) {
+    return type >= MEMFAULT_HID_REPORT_TYPE_INPUT && type <= MEMFAULT_HID_REPORT_TYPE_FEATURE;
+}
+
+int memfault_hid_get_report_size(memfault_hid_device_t *device,
+                                 memfault_hid_report_type_t type,
+                                 uint8_t report_id) {
+    if (device == NULL || !report_type_valid(type)) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    if (!device->descriptor_valid) {
+        return MEMFAULT_HID_ERROR_NOT_SUPPORTED;
+    }
+
+    uint16_t size = device->report_sizes[type - 1][report_id];
+    if (size == 0) {
+        return MEMFAULT_HID_ERROR_NOT_FOUND;
+    }
+
+    return size;
+}
+
+int memfault_hid_get_max_report_size(memfault_hid_device_t *device,
+                                     memfault_hid_report_type_t type) {
+    if (device == NULL || !report_type_valid(type)) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    return (int)device->max_report_size[type - 1];
+}
+
 /* ============================================================================
  * Report Filtering
  * ========================================================================== */
@@ -225,23 +612,22 @@ int memfault_hid_set_report_filter(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    /* Free existing filter */
-    if (device->filter.report_ids) {
-        free(device->filter.report_ids);
-        device->filter.report_ids = NULL;
-    }
-
-    /* Copy new filter */
-    if (filter->num_report_ids > 0 && filter->report_ids != NULL) {
-        device->filter.report_ids = malloc(filter->num_report_ids);
-        if (device->filter.report_ids == NULL) {
-            return MEMFAULT_HID_ERROR_NO_MEM;
+    memset(device->filter_bitmap, 0, sizeof(device->filter_bitmap));
+    device->filter_num_ids = 0;
+
+    /* Build the bitmap; duplicate IDs are stored once */
+    if (filter->report_ids != NULL) {
+        for (size_t i = 0; i < filter->num_report_ids; i++) {
+            uint8_t id = filter->report_ids[i];
+            if (device->filter_bitmap[id / 32] & (1u << (id % 32))) {
+                continue;
+            }
+            device->filter_bitmap[id / 32] |= 1u << (id % 32);
+            device->filter_ids[device->filter_num_ids++] = id;
         }
-        memcpy(device->filter.report_ids, filter->report_ids, filter->num_report_ids);
     }
 
-    device->filter.num_report_ids = filter->num_report_ids;
-    device->filter.filter_enabled = filter->filter_enabled;
+    device->filter_enabled = filter->filter_enabled;
 
     return MEMFAULT_HID_SUCCESS;
 }
@@ -252,9 +638,10 @@ int memfault_hid_get_report_filter(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    filter->report_ids = device->filter.report_ids;
-    filter->num_report_ids = device->filter.num_report_ids;
-    filter->filter_enabled = device->filter.filter_enabled;
+    /* Points into the device handle; valid until the filter is changed */
+    filter->report_ids = device->filter_num_ids > 0 ? device->filter_ids : NULL;
+    filter->num_report_ids = device->filter_num_ids;
+    filter->filter_enabled = device->filter_enabled;
 
     return MEMFAULT_HID_SUCCESS;
 }
@@ -264,17 +651,50 @@ int memfault_hid_get_report_filter(memfault_hid_device_t *device,
  * ========================================================================== */
 
 static bool is_report_filtered(memfault_hid_device_t *device, uint8_t report_id) {
-    if (!device->filter.filter_enabled) {
+    if (!device->filter_enabled) {
         return false;
     }
 
-    for (size_t i = 0; i < device->filter.num_report_ids; i++) {
-        if (device->filter.report_ids[i] == report_id) {
-            return false;  /* Report ID is in filter list, don't filter it */
+    /* Filter out Report IDs not in the filter list */
+    return !(device->filter_bitmap[report_id / 32] & (1u << (report_id % 32)));
+}
+
+/* Writer thread: writes each report handed over by memfault_hid_write_report() */
+static void *writer_main(void *arg) {
+    memfault_hid_device_t *device = arg;
+
+    pthread_mutex_lock(&device->write_lock);
+    while (!device->writer_stop) {
+        if (!device->write_pending) {
+            pthread_cond_wait(&device->write_cond, &device->write_lock);
+            continue;
         }
+
+        size_t len = device->write_len;
+        pthread_mutex_unlock(&device->write_lock);
+        int result = hid_write(device->handle, device->write_buffer, len);
+        pthread_mutex_lock(&device->write_lock);
+
+        device->write_result = result;
+        device->write_pending = false;
+        pthread_cond_broadcast(&device->write_cond);
     }
+    pthread_mutex_unlock(&device->write_lock);
 
-    return true;  /* Report ID not in filter list, filter it out */
+    return NULL;
+}
+
+/* Wait with write_lock held until no write is pending or the deadline passes */
+static bool wait_write_idle(memfault_hid_device_t *device, const struct timespec *deadline) {
+    while (device->write_pending) {
+        if (deadline == NULL) {
+            pthread_cond_wait(&device->write_cond, &device->write_lock);
+        } else if (pthread_cond_timedwait(&device->write_cond, &device->write_lock,
+                                          deadline) == ETIMEDOUT) {
+            return !device->write_pending;
+        }
+    }
+    return true;
 }
 
 int memfault_hid_write_report(memfault_hid_device_t *device,
@@ -290,14 +710,71 @@ int memfault_hid_write_report(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
     }
 
-    (void)timeout_ms;  /* hidapi doesn't support write timeout */
+    if (length >= device->tx_buffer_size) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    struct timespec deadline;
+    if (timeout_ms >= 0) {
+        clock_gettime(WRITE_CLOCK, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&device->write_lock);
+
+    /* An earlier timed-out write may still be in flight */
+    if (!wait_write_idle(device, timeout_ms >= 0 ? &deadline : NULL)) {
+        pthread_mutex_unlock(&device->write_lock);
+        return MEMFAULT_HID_ERROR_TIMEOUT;
+    }
 
     /* Prepare buffer with Report ID */
-    uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
-    buffer[0] = report_id;
-    memcpy(buffer + 1, data, length);
+    device->write_buffer[0] = report_id;
+    memcpy(device->write_buffer + 1, data, length);
+    device->write_len = length + 1;
+
+    int result;
+    if (timeout_ms < 0) {
+        /* Unbounded: write on the calling thread */
+        device->write_pending = true;
+        pthread_mutex_unlock(&device->write_lock);
+        result = hid_write(device->handle, device->write_buffer, length + 1);
+        pthread_mutex_lock(&device->write_lock);
+        device->write_pending = false;
+        pthread_cond_broadcast(&device->write_cond);
+    } else {
+        if (!device->writer_running) {
+            if (pthread_create(&device->writer, NULL, writer_main, device) != 0) {
+                pthread_mutex_unlock(&device->write_lock);
+                return MEMFAULT_HID_ERROR_NO_MEM;
+            }
+            device->writer_running = true;
+        }
+
+        device->write_pending = true;
+        pthread_cond_broadcast(&device->write_cond);
+
+        /* Don't wait: the report is handed off */
+        if (timeout_ms == 0) {
+            pthread_mutex_unlock(&device->write_lock);
+            return (int)length;
+        }
+
+        /* On timeout the report stays queued and is written when the device recovers */
+        if (!wait_write_idle(device, &deadline)) {
+            pthread_mutex_unlock(&device->write_lock);
+            return MEMFAULT_HID_ERROR_TIMEOUT;
+        }
+        result = device->write_result;
+    }
+
+    pthread_mutex_unlock(&device->write_lock);
 
-    int result = hid_write(device->handle, buffer, length + 1);
     if (result < 0) {
         return MEMFAULT_HID_ERROR_IO;
     }
@@ -305,6 +782,34 @@ int memfault_hid_write_report(memfault_hid_device_t *device,
     return result - 1;  /* Don't count the Report ID byte */
 }
 
+/* Read one report into buffer; timeout_ms follows hid_read_timeout() */
+static int read_raw(memfault_hid_device_t *device, uint8_t *buffer, size_t length,
+                    int timeout_ms) {
+    int result = hid_read_timeout(device->handle, buffer, length, timeout_ms);
+
+    if (result < 0) {
+        return MEMFAULT_HID_ERROR_IO;
+    }
+
+    if (result == 0) {
+        return MEMFAULT_HID_ERROR_TIMEOUT;
+    }
+
+    if (is_report_filtered(device, buffer[0])) {
+        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
+    }
+
+    return result;
+}
+
+/* Map a public timeout to hid_read_timeout(); 0 follows the blocking mode like hid_read() */
+static int hid_timeout(memfault_hid_device_t *device, int timeout_ms) {
+    if (timeout_ms == 0) {
+        return device->nonblocking ? 0 : -1;
+    }
+    return timeout_ms;
+}
+
 int memfault_hid_read_report(memfault_hid_device_t *device,
                               uint8_t *report_id,
                               uint8_t *data,
@@ -314,32 +819,16 @@ int memfault_hid_read_report(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
-    int result;
-
-    if (timeout_ms == 0) {
-        result = hid_read(device->handle, buffer, sizeof(buffer));
-    } else {
-        result = hid_read_timeout(device->handle, buffer, sizeof(buffer), timeout_ms);
-    }
-
+    uint8_t *buffer = device->rx_buffer;
+    int result = read_raw(device, buffer, device->rx_buffer_size,
+                          hid_timeout(device, timeout_ms));
     if (result < 0) {
-        return MEMFAULT_HID_ERROR_IO;
-    }
-
-    if (result == 0) {
-        return MEMFAULT_HID_ERROR_TIMEOUT;
+        return result;
     }
 
     /* First byte is Report ID */
-    uint8_t rid = buffer[0];
-
-    if (is_report_filtered(device, rid)) {
-        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
-    }
-
     if (report_id) {
-        *report_id = rid;
+        *report_id = buffer[0];
     }
 
     /* Copy data (excluding Report ID) */
@@ -352,6 +841,83 @@ int memfault_hid_read_report(memfault_hid_device_t *device,
     return (int)data_len;
 }
 
+int memfault_hid_read_raw_report(memfault_hid_device_t *device,
+                                 uint8_t *buffer,
+                                 size_t length,
+                                 int timeout_ms) {
+    if (device == NULL || buffer == NULL || length < 1) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    return read_raw(device, buffer, length, hid_timeout(device, timeout_ms));
+}
+
+int memfault_hid_read_reports(memfault_hid_device_t *device,
+                              memfault_hid_raw_report_t *reports,
+                              size_t max_reports,
+                              int timeout_ms) {
+    if (device == NULL || reports == NULL || max_reports == 0) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    /* hidraw silently truncates reads into short buffers, so refuse them */
+    size_t min_size = device->max_report_size[MEMFAULT_HID_REPORT_TYPE_INPUT - 1] + 1;
+    for (size_t i = 0; i < max_reports; i++) {
+        if (reports[i].buffer == NULL || reports[i].size < min_size) {
+            return MEMFAULT_HID_ERROR_INVALID_PARAM;
+        }
+    }
+
+    size_t count = 0;
+    int wait_ms = hid_timeout(device, timeout_ms);
+    int result = MEMFAULT_HID_ERROR_TIMEOUT;
+
+    while (count < max_reports) {
+        memfault_hid_raw_report_t *report = &reports[count];
+
+        result = read_raw(device, report->buffer, report->size, wait_ms);
+        if (result == MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE) {
+            wait_ms = 0;
+            continue;  /* Consumed but filtered out */
+        }
+        if (result < 0) {
+            break;
+        }
+
+        report->length = (size_t)result;
+        count++;
+
+        /* Only wait for the first report, then drain what is queued */
+        wait_ms = 0;
+    }
+
+    if (count == 0) {
+        return result;
+    }
+
+    return (int)count;
+}
+
+int memfault_hid_read_report_view(memfault_hid_device_t *device,
+                                  memfault_hid_report_view_t *view,
+                                  int timeout_ms) {
+    if (device == NULL || view == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    int result = memfault_hid_read_raw_report(device, device->rx_buffer,
+                                              device->rx_buffer_size, timeout_ms);
+    if (result < 0) {
+        return result;
+    }
+
+    view->report_id = device->rx_buffer[0];
+    view->data = &device->rx_buffer[1];
+    view->length = (size_t)(result - 1);
+
+    return result - 1;
+}
+
 int memfault_hid_get_feature_report(memfault_hid_device_t *device,
                                      uint8_t report_id,
                                      uint8_t *data,
@@ -364,17 +930,30 @@ int memfault_hid_get_feature_report(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
     }
 
-    uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
+    /* Ask for the declared report size; the device may send less */
+    size_t request_len = device->report_sizes[2][report_id];
+    if (request_len == 0) {
+        request_len = length;
+    }
+    if (request_len >= device->tx_buffer_size) {
+        request_len = device->tx_buffer_size - 1;
+    }
+
+    uint8_t *buffer = device->tx_buffer;
     buffer[0] = report_id;
 
-    int result = hid_get_feature_report(device->handle, buffer, length + 1);
+    int result = hid_get_feature_report(device->handle, buffer, request_len + 1);
     if (result < 0) {
         return MEMFAULT_HID_ERROR_IO;
     }
 
     /* Copy data (excluding Report ID) */
-    memcpy(data, buffer + 1, result - 1);
-    return result - 1;
+    size_t data_len = result > 0 ? (size_t)(result - 1) : 0;
+    if (data_len > length) {
+        data_len = length;
+    }
+    memcpy(data, buffer + 1, data_len);
+    return (int)data_len;
 }
 
 int memfault_hid_set_feature_report(memfault_hid_device_t *device,
@@ -389,7 +968,11 @@ int memfault_hid_set_feature_report(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
     }
 
-    uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
+    if (length >= device->tx_buffer_size) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t *buffer = device->tx_buffer;
     buffer[0] = report_id;
     memcpy(buffer + 1, data, length);
 
@@ -0,0 +1,73 @@
+/**
+ * @file memfault_hid_descriptor.h
+ * @brief HID report descriptor item walker (internal)
+ *
+ * Shared by the report size parser in memfault_hid.c and the MDS device
+ * matcher in mds_hotplug.c. Not part of the public API.
+ */
+
+#ifndef MEMFAULT_HID_DESCRIPTOR_H
+#define MEMFAULT_HID_DESCRIPTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Item types */
+#define MEMFAULT_HID_ITEM_MAIN      0
+#define MEMFAULT_HID_ITEM_GLOBAL    1
+#define MEMFAULT_HID_ITEM_LOCAL     2
+
+/**
+ * @brief One short item of a report descriptor
+ */
+typedef struct {
+    uint8_t type;                    /* MEMFAULT_HID_ITEM_* */
+    uint8_t tag;                     /* Item tag (upper four prefix bits) */
+    uint8_t size;                    /* Data bytes: 0, 1, 2 or 4 */
+    uint32_t value;                  /* Data, little-endian, zero-extended */
+} memfault_hid_item_t;
+
+/**
+ * @brief Decode the next short item and advance past it
+ *
+ * Long items are skipped. Start with *pos at 0.
+ *
+ * @return true if an item was decoded, false at the end of the descriptor
+ *         or at a truncated item
+ */
+static inline bool memfault_hid_descriptor_next(const uint8_t *desc, size_t len, size_t *pos,
+                                                memfault_hid_item_t *item) {
+    while (*pos < len) {
+        uint8_t prefix = desc[(*pos)++];
+
+        if (prefix == 0xFE) {
+            /* Long item: data size, tag, data */
+            if (*pos >= len) {
+                return false;
+            }
+            *pos += 2 + (size_t)desc[*pos];
+            continue;
+        }
+
+        size_t size = (prefix & 0x03) == 0x03 ? 4 : (prefix & 0x03);
+        if (size > len - *pos) {
+            return false;
+        }
+
+        item->value = 0;
+        for (size_t i = 0; i < size; i++) {
+            item->value |= (uint32_t)desc[*pos + i] << (8 * i);
+        }
+        *pos += size;
+
+        item->type = (prefix >> 2) & 0x03;
+        item->tag = prefix >> 4;
+        item->size = (uint8_t)size;
+        return true;
+    }
+
+    return false;
+}
+
+#endif /* MEMFAULT_HID_DESCRIPTOR_H */
@@ -0,0 +1,190 @@
+/**
+ * @file compress_bench.c
+ * @brief Compression CPU cost vs bytes saved for upload bodies
+ *
+ * Splits a sample file (for example chunks captured from a device) into
+ * fixed-size chunks and compresses each one the way the uploader does,
+ * for every encoding and level. Prints the CPU time spent and the request
+ * bytes saved, plus the break-even uplink rate: on links slower than that,
+ * compressing costs less time than sending the saved bytes.
+ *
+ * The zlib settings mirror compress_body() in src/mds_upload.c: one stream
+ * per configuration, reset per chunk, output bounded by the input size and
+ * chunks that do not shrink sent as-is. Keep the two in sync.
+ *
+ * Build and run:
+ *
+ *   cc -std=gnu11 -O2 -o compress_bench tools/compress_bench.c -lz
+ *   ./compress_bench chunks.bin [chunk_size] [min_size]
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+/* Repeat each configuration until it has used this much CPU time */
+#define MIN_CPU_NS 200000000ULL
+
+typedef struct {
+    const char *name;
+    int window_bits;
+} encoding_t;
+
+static const encoding_t encodings[] = {
+    {"gzip", 15 + 16},
+    {"deflate", 15},
+};
+
+typedef struct {
+    uint64_t cpu_ns;
+    size_t rounds;
+    size_t chunks;
+    size_t compressed;
+    size_t bytes_in;
+    size_t bytes_out;
+} result_t;
+
+static uint64_t cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    size_t cap = 1 << 16;
+    size_t used = 0;
+    uint8_t *data = malloc(cap);
+    while (data != NULL) {
+        used += fread(data + used, 1, cap - used, f);
+        if (used < cap) {
+            break;
+        }
+        uint8_t *grown = realloc(data, cap * 2);
+        if (grown == NULL) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        cap *= 2;
+    }
+
+    if (ferror(f)) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = used;
+    return data;
+}
+
+/* Compress one chunk; returns the compressed length, or 0 if sent as-is */
+static size_t compress_chunk(z_stream *zs, uint8_t *out, const uint8_t *data, size_t len) {
+    if (deflateReset(zs) != Z_OK) {
+        return 0;
+    }
+
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)len;
+    zs->next_out = out;
+    zs->avail_out = (uInt)len;
+
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END) {
+        return 0;
+    }
+    return len - zs->avail_out;
+}
+
+static int run(const encoding_t *encoding, int level, const uint8_t *data, size_t len,
+               size_t chunk_size, size_t min_size, result_t *result) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, encoding->window_bits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -ENOMEM;
+    }
+
+    uint8_t *out = malloc(chunk_size);
+    if (out == NULL) {
+        deflateEnd(&zs);
+        return -ENOMEM;
+    }
+
+    memset(result, 0, sizeof(*result));
+    uint64_t start = cpu_ns();
+    do {
+        for (size_t off = 0; off < len; off += chunk_size) {
+            size_t n = len - off < chunk_size ? len - off : chunk_size;
+            size_t compressed = n >= min_size ? compress_chunk(&zs, out, data + off, n) : 0;
+
+            /* Sizes are the same every round; count them once */
+            if (result->rounds == 0) {
+                result->chunks++;
+                result->bytes_in += n;
+                result->bytes_out += compressed > 0 ? compressed : n;
+                result->compressed += compressed > 0;
+            }
+        }
+        result->rounds++;
+        result->cpu_ns = cpu_ns() - start;
+    } while (result->cpu_ns < MIN_CPU_NS);
+
+    free(out);
+    deflateEnd(&zs);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "Usage: %s FILE [chunk_size] [min_size]\n", argv[0]);
+        return 2;
+    }
+
+    size_t chunk_size = argc > 2 ? strtoul(argv[2], NULL, 0) : 1024;
+    size_t min_size = argc > 3 ? strtoul(argv[3], NULL, 0) : 0;
+    if (chunk_size == 0) {
+        fprintf(stderr, "chunk_size must be positive\n");
+        return 2;
+    }
+
+    size_t len = 0;
+    uint8_t *data = read_file(argv[1], &len);
+    if (data == NULL || len == 0) {
+        fprintf(stderr, "%s: %s\n", argv[1], data == NULL ? strerror(errno) : "empty file");
+        free(data);
+        return 1;
+    }
+
+    printf("%zu bytes, %zu-byte chunks, min_size %zu\n\n", len, chunk_size, min_size);
+    printf("%-8s %5s %9s %11s %7s %11s %11s %14s\n", "encoding", "level", "chunks",
+           "compressed", "ratio", "saved", "us/chunk", "break-even");
+
+    for (size_t e = 0; e < sizeof(encodings) / sizeof(encodings[0]); e++) {
+        for (int level = 1; level <= 9; level++) {
+            result_t r;
+            if (run(&encodings[e], level, data, len, chunk_size, min_size, &r) != 0) {
+                fprintf(stderr, "deflateInit2 failed\n");
+                free(data);
+                return 1;
+            }
+
+            double cpu_s = (double)r.cpu_ns / 1e9 / (double)r.rounds;
+            size_t saved = r.bytes_in - r.bytes_out;
+            printf("%-8s %5d %9zu %11zu %6.1f%% %11zu %11.2f %9.1f kB/s\n", encodings[e].name,
+                   level, r.chunks, r.compressed, 100.0 * (double)r.bytes_out / (double)r.bytes_in,
+                   saved, cpu_s * 1e6 / (double)r.chunks, (double)saved / cpu_s / 1000.0);
+        }
+    }
+
+    free(data);
+    return 0;
+}
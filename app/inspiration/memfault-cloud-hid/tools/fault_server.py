@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Stand-in chunks endpoint that injects errors, for testing the uploader.
+
+The failure behaviour is encoded in the request path, so one server serves
+every test scenario. Path segments are key=value pairs, in any order:
+
+  f=N     fail the first N requests to this path (f=-1: always fail)
+  s=CODE  HTTP status of failed requests (default 503)
+  ra=S    send "Retry-After: S" with failed requests
+  d=MS    delay failed responses by MS milliseconds
+
+Other segments (e.g. dev=a) only make the path unique. Successful requests
+get 202. Every request is logged to stdout as one line:
+
+  <monotonic ms> <path> <status> <first body byte, hex>
+
+Usage: fault_server.py PORT
+"""
+
+import http.server
+import sys
+import threading
+import time
+
+counts = {}
+counts_lock = threading.Lock()
+
+
+def parse_rules(path):
+    rules = {"f": 0, "s": 503, "ra": None, "d": 0}
+    for segment in path.strip("/").split("/"):
+        key, sep, value = segment.partition("=")
+        if sep and key in rules:
+            rules[key] = int(value)
+    return rules
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        rules = parse_rules(self.path)
+
+        with counts_lock:
+            counts[self.path] = counts.get(self.path, 0) + 1
+            attempt = counts[self.path]
+
+        fail = rules["f"] < 0 or attempt <= rules["f"]
+        status = rules["s"] if fail else 202
+        if fail and rules["d"] > 0:
+            time.sleep(rules["d"] / 1000.0)
+
+        print("%d %s %d %s" % (time.monotonic() * 1000, self.path, status, body[:1].hex()),
+              flush=True)
+
+        self.send_response(status)
+        if fail and rules["ra"] is not None:
+            self.send_header("Retry-After", str(rules["ra"]))
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def do_HEAD(self):
+        self.send_response(204)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", int(sys.argv[1])), Handler)
+    server.daemon_threads = True
+    server.serve_forever()
@@ -0,0 +1,196 @@
+/**
+ * @file header_alloc_bench.c
+ * @brief Heap allocations per uploaded chunk, header cache warm and cold
+ *
+ * Uploads chunks through mds_uploader_callback() against tools/fault_server.py
+ * (which answers 202 to paths without failure rules) and counts heap
+ * allocations per chunk in two places:
+ *
+ *   ours   calls to malloc/calloc/realloc/strdup made by the uploader sources,
+ *          via the linker's --wrap option
+ *   total  every malloc/calloc/realloc in the process, libcurl included,
+ *          via interposed definitions that forward to glibc
+ *
+ * "warm" sends every chunk with the same authorization header, so the header
+ * cache always hits. "cold" rotates through more authorization headers than
+ * the cache holds, so every chunk misses and rebuilds its header list.
+ * Connection setup is excluded by uploading warm-up chunks first.
+ *
+ * Needs glibc (__libc_malloc and friends). Build and run:
+ *
+ *   cc -std=gnu11 -O2 -Iinclude -o header_alloc_bench tools/header_alloc_bench.c \
+ *       src/mds_upload.c src/mds_spool.c \
+ *       -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup \
+ *       -lcurl -lz -lpthread
+ *   python3 tools/fault_server.py 18480 > /dev/null &
+ *   ./header_alloc_bench http://127.0.0.1:18480 [chunks]
+ */
+
+#include "memfault_hid/mds_upload.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* More than MDS_HEADER_CACHE_SIZE in src/mds_upload.c, so LRU always misses */
+#define COLD_AUTH_HEADERS   8
+#define WARMUP_CHUNKS       16
+#define CHUNK_LEN           256
+
+/* ============================================================================
+ * Allocation Counters
+ * ========================================================================== */
+
+static atomic_size_t g_ours;
+static atomic_size_t g_total;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&g_total, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    atomic_fetch_add_explicit(&g_total, 1, memory_order_relaxed);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&g_total, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+/* Only references from our object files are redirected here by --wrap */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&g_ours, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    atomic_fetch_add_explicit(&g_ours, 1, memory_order_relaxed);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&g_ours, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    atomic_fetch_add_explicit(&g_ours, 1, memory_order_relaxed);
+    return __real_strdup(s);
+}
+
+/* ============================================================================
+ * Benchmark
+ * ========================================================================== */
+
+typedef struct {
+    size_t chunks;
+    size_t ours;
+    size_t total;
+    uint64_t wall_ns;
+} result_t;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int send_chunks(mds_uploader_t *uploader, const char *uri, size_t auth_count,
+                       size_t first, size_t count) {
+    uint8_t chunk[CHUNK_LEN];
+    char auth_header[64];
+
+    for (size_t i = first; i < first + count; i++) {
+        /* Distinct contents, in case dedup is ever enabled by default */
+        memset(chunk, (int)(i & 0xFF), sizeof(chunk));
+        memcpy(chunk, &i, sizeof(i));
+        snprintf(auth_header, sizeof(auth_header), "Memfault-Project-Key:bench-%zu",
+                 i % auth_count);
+
+        int ret = mds_uploader_callback(uri, auth_header, chunk, sizeof(chunk), uploader);
+        if (ret != 0) {
+            fprintf(stderr, "chunk %zu: upload returned %d\n", i, ret);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static int run(const char *uri, size_t auth_count, size_t chunks, result_t *result) {
+    mds_uploader_t *uploader = mds_uploader_create();
+    if (uploader == NULL) {
+        fprintf(stderr, "mds_uploader_create failed\n");
+        return -1;
+    }
+
+    /* Open the connection and fill the caches before counting */
+    int ret = send_chunks(uploader, uri, auth_count, 0, WARMUP_CHUNKS);
+    if (ret == 0) {
+        size_t ours = atomic_load(&g_ours);
+        size_t total = atomic_load(&g_total);
+        uint64_t start = monotonic_ns();
+
+        ret = send_chunks(uploader, uri, auth_count, WARMUP_CHUNKS, chunks);
+
+        result->wall_ns = monotonic_ns() - start;
+        result->ours = atomic_load(&g_ours) - ours;
+        result->total = atomic_load(&g_total) - total;
+        result->chunks = chunks;
+    }
+
+    mds_uploader_destroy(uploader);
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s BASE_URL [chunks]\n", argv[0]);
+        return 2;
+    }
+
+    size_t chunks = argc > 2 ? strtoul(argv[2], NULL, 0) : 2000;
+    if (chunks == 0) {
+        fprintf(stderr, "chunks must be positive\n");
+        return 2;
+    }
+
+    char uri[256];
+    snprintf(uri, sizeof(uri), "%s/dev=header-alloc-bench", argv[1]);
+
+    static const struct {
+        const char *name;
+        size_t auth_count;
+    } modes[] = {
+        {"warm", 1},
+        {"cold", COLD_AUTH_HEADERS},
+    };
+
+    printf("%zu chunks of %d bytes per run\n\n", chunks, CHUNK_LEN);
+    printf("%-6s %12s %12s %12s\n", "cache", "ours/chunk", "total/chunk", "us/chunk");
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        result_t r;
+        if (run(uri, modes[m].auth_count, chunks, &r) != 0) {
+            return 1;
+        }
+        printf("%-6s %12.2f %12.2f %12.1f\n", modes[m].name,
+               (double)r.ours / (double)r.chunks, (double)r.total / (double)r.chunks,
+               (double)r.wall_ns / 1000.0 / (double)r.chunks);
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file lz4_frame_bench.c
+ * @brief Compressed stream mode: ratio and drain time for a captured coredump
+ *
+ * Splits a capture of the device's packetizer output (for example a 32 KB
+ * RAM-backed coredump, as the uncompressed chunks a gateway uploaded,
+ * concatenated) into frames and compresses each one with the firmware's
+ * encoder in app/src/mds_lz4.c, the way mds_tx_frame_load() in
+ * app/src/mds_hid.c does: a 2-byte raw length header, then the LZ4 block,
+ * or the raw chunk ("stored") if the block is not smaller.
+ *
+ * Prints the compression ratio and the number of Stream Data reports the
+ * data takes in compressed mode (one frame control byte per report) and in
+ * the uncompressed modes. The drain time assumes one report per 1 ms
+ * full-speed interrupt interval. Encoder CPU time on the device is not
+ * modelled; measure it on hardware.
+ *
+ * The frame and report layout mirrors app/src/mds_hid.c. Keep the two in
+ * sync. Build and run (from this directory):
+ *
+ *   cc -std=gnu11 -O2 -I../../src -o lz4_frame_bench tools/lz4_frame_bench.c \
+ *       ../../src/mds_lz4.c
+ *   ./lz4_frame_bench coredump.bin [frame_len]
+ */
+
+#include "mds_lz4.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* From app/src/mds_hid.c */
+#define MDS_COMPRESS_FRAME_LEN      1024
+#define MDS_FRAME_HEADER_LEN        2     /* Raw length, little-endian */
+#define MDS_MAX_CHUNK_DATA_LEN      61    /* Legacy header */
+#define MDS_MAX_CHUNK_DATA_LEN_EXT  60    /* Extended header; implied by compression */
+#define MDS_FRAME_SLICE_LEN         (MDS_MAX_CHUNK_DATA_LEN_EXT - 1)  /* Less control byte */
+
+/* Full-speed interrupt endpoint, bInterval 1 */
+#define REPORT_INTERVAL_US          1000
+
+typedef struct {
+    size_t frames;
+    size_t stored;
+    size_t bytes_in;
+    size_t bytes_out;       /* Frame bytes, headers included */
+    size_t reports;
+} result_t;
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    size_t cap = 1 << 16;
+    size_t used = 0;
+    uint8_t *data = malloc(cap);
+    while (data != NULL) {
+        used += fread(data + used, 1, cap - used, f);
+        if (used < cap) {
+            break;
+        }
+        uint8_t *grown = realloc(data, cap * 2);
+        if (grown == NULL) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        cap *= 2;
+    }
+
+    if (ferror(f)) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = used;
+    return data;
+}
+
+static size_t div_round_up(size_t n, size_t d) {
+    return (n + d - 1) / d;
+}
+
+/* Frame one chunk like mds_tx_frame_load(); returns the frame length */
+static size_t frame_chunk(const uint8_t *raw, size_t raw_len, uint8_t *frame, bool *stored) {
+    frame[0] = raw_len & 0xFF;
+    frame[1] = raw_len >> 8;
+
+    int ret = mds_lz4_compress(raw, raw_len, &frame[MDS_FRAME_HEADER_LEN], raw_len - 1);
+    if (ret > 0) {
+        *stored = false;
+        return MDS_FRAME_HEADER_LEN + (size_t)ret;
+    }
+
+    memcpy(&frame[MDS_FRAME_HEADER_LEN], raw, raw_len);
+    *stored = true;
+    return MDS_FRAME_HEADER_LEN + raw_len;
+}
+
+static int run(const uint8_t *data, size_t len, size_t frame_len, result_t *result) {
+    uint8_t *frame = malloc(MDS_FRAME_HEADER_LEN + frame_len);
+    if (frame == NULL) {
+        return -ENOMEM;
+    }
+
+    memset(result, 0, sizeof(*result));
+    for (size_t off = 0; off < len; off += frame_len) {
+        size_t n = len - off < frame_len ? len - off : frame_len;
+        bool stored;
+        size_t out = frame_chunk(data + off, n, frame, &stored);
+
+        result->frames++;
+        result->stored += stored;
+        result->bytes_in += n;
+        result->bytes_out += out;
+        result->reports += div_round_up(out, MDS_FRAME_SLICE_LEN);
+    }
+
+    free(frame);
+    return 0;
+}
+
+static void print_row(const char *mode, size_t payload, size_t reports, size_t baseline) {
+    printf("%-14s %11zu %9zu %11.1f %8.1f%%\n", mode, payload, reports,
+           (double)reports * REPORT_INTERVAL_US / 1000.0,
+           100.0 * (double)reports / (double)baseline);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s FILE [frame_len]\n", argv[0]);
+        return 2;
+    }
+
+    size_t frame_len = argc > 2 ? strtoul(argv[2], NULL, 0) : MDS_COMPRESS_FRAME_LEN;
+    if (frame_len == 0 || frame_len > MDS_LZ4_MAX_INPUT_LEN) {
+        fprintf(stderr, "frame_len must be between 1 and %u\n", MDS_LZ4_MAX_INPUT_LEN);
+        return 2;
+    }
+
+    size_t len = 0;
+    uint8_t *data = read_file(argv[1], &len);
+    if (data == NULL || len == 0) {
+        fprintf(stderr, "%s: %s\n", argv[1], data == NULL ? strerror(errno) : "empty file");
+        free(data);
+        return 1;
+    }
+
+    result_t r;
+    if (run(data, len, frame_len, &r) != 0) {
+        fprintf(stderr, "out of memory\n");
+        free(data);
+        return 1;
+    }
+
+    printf("%zu bytes, %zu-byte frames: %zu frames, %zu stored\n", len, frame_len, r.frames,
+           r.stored);
+    printf("frame bytes %zu (%.1f%% of input, %.2fx)\n\n", r.bytes_out,
+           100.0 * (double)r.bytes_out / (double)r.bytes_in,
+           (double)r.bytes_in / (double)r.bytes_out);
+
+    /* Packetizer chunk framing is ignored: the capture is treated as one stream */
+    size_t legacy = div_round_up(len, MDS_MAX_CHUNK_DATA_LEN);
+    size_t extended = div_round_up(len, MDS_MAX_CHUNK_DATA_LEN_EXT);
+
+    printf("%-14s %11s %9s %11s %9s\n", "mode", "payload", "reports", "drain ms", "vs plain");
+    print_row("plain", len, legacy, legacy);
+    print_row("plain, ext seq", len, extended, legacy);
+    print_row("compressed", r.bytes_out, r.reports, legacy);
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,272 @@
+/**
+ * @file read_bench.c
+ * @brief memfault_hid_read_reports() vs looped memfault_hid_read_report()
+ *
+ * Creates a virtual MDS device with Linux uhid, queues batches of Stream
+ * Data reports on it and times how long each read path takes to drain them:
+ * one memfault_hid_read_report() call per report, or memfault_hid_read_reports()
+ * for the whole backlog. hidraw queues at most 64 reports per reader, so that
+ * is the largest batch.
+ *
+ * Needs Linux with the uhid module, write access to /dev/uhid (usually root)
+ * and hidapi's hidraw backend:
+ *
+ *   cc -std=gnu11 -O2 -Iinclude -o read_bench tools/read_bench.c src/memfault_hid.c \
+ *       $(pkg-config --cflags --libs hidapi-hidraw) -lpthread
+ *   sudo ./read_bench [reports_per_run]
+ */
+
+#include "memfault_hid/memfault_hid.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uhid.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#define BENCH_VID           0x1209
+#define BENCH_PID           0x0001
+#define STREAM_REPORT_ID    0x06
+#define STREAM_REPORT_LEN   63
+#define HIDRAW_QUEUE_LEN    64
+#define READ_TIMEOUT_MS     1000
+
+/* Vendor collection with a 63-byte Stream Data input report */
+static const uint8_t report_descriptor[] = {
+    0x06, 0x00, 0xFF,        /* Usage Page (Vendor Defined 0xFF00) */
+    0x09, 0x01,              /* Usage (0x01) */
+    0xA1, 0x01,              /* Collection (Application) */
+    0x85, STREAM_REPORT_ID,  /*   Report ID */
+    0x15, 0x00,              /*   Logical Minimum (0) */
+    0x26, 0xFF, 0x00,        /*   Logical Maximum (255) */
+    0x75, 0x08,              /*   Report Size (8) */
+    0x95, STREAM_REPORT_LEN, /*   Report Count */
+    0x09, 0x01,              /*   Usage (0x01) */
+    0x81, 0x02,              /*   Input (Data, Variable, Absolute) */
+    0xC0,                    /* End Collection */
+};
+
+typedef enum {
+    MODE_SINGLE,
+    MODE_BATCH,
+} read_mode_t;
+
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    size_t reports;
+    size_t calls;
+} bench_result_t;
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int uhid_write(int fd, const struct uhid_event *ev) {
+    ssize_t ret = write(fd, ev, sizeof(*ev));
+    if (ret < 0) {
+        return -errno;
+    }
+    return ret == (ssize_t)sizeof(*ev) ? 0 : -EFAULT;
+}
+
+static int uhid_create(int fd, const char *uniq) {
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "MDS read benchmark");
+    snprintf((char *)ev.u.create2.uniq, sizeof(ev.u.create2.uniq), "%s", uniq);
+    memcpy(ev.u.create2.rd_data, report_descriptor, sizeof(report_descriptor));
+    ev.u.create2.rd_size = sizeof(report_descriptor);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = BENCH_VID;
+    ev.u.create2.product = BENCH_PID;
+    return uhid_write(fd, &ev);
+}
+
+static void uhid_destroy(int fd) {
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    uhid_write(fd, &ev);
+}
+
+/* Queue count Stream Data reports; the first data byte is the sequence */
+static int uhid_inject(int fd, size_t count, uint8_t *sequence) {
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = 1 + STREAM_REPORT_LEN;
+    ev.u.input2.data[0] = STREAM_REPORT_ID;
+
+    for (size_t i = 0; i < count; i++) {
+        ev.u.input2.data[1] = (*sequence)++ & 0x1F;
+        memset(&ev.u.input2.data[2], 0xA5, STREAM_REPORT_LEN - 1);
+        int ret = uhid_write(fd, &ev);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/* The virtual device appears once udev has created its hidraw node */
+static int open_bench_device(const wchar_t *serial, memfault_hid_device_t **device) {
+    for (int i = 0; i < 100; i++) {
+        if (memfault_hid_open(BENCH_VID, BENCH_PID, serial, device) == MEMFAULT_HID_SUCCESS) {
+            return 0;
+        }
+        usleep(20000);
+    }
+    return -ENODEV;
+}
+
+static int drain_single(memfault_hid_device_t *device, size_t count, uint8_t *expected,
+                        bench_result_t *result) {
+    uint8_t data[STREAM_REPORT_LEN];
+    for (size_t i = 0; i < count; i++) {
+        uint8_t report_id;
+        int ret = memfault_hid_read_report(device, &report_id, data, sizeof(data),
+                                           READ_TIMEOUT_MS);
+        result->calls++;
+        if (ret < 1 || report_id != STREAM_REPORT_ID || data[0] != (*expected)++ % 32) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
+static int drain_batch(memfault_hid_device_t *device, memfault_hid_raw_report_t *reports,
+                       size_t count, uint8_t *expected, bench_result_t *result) {
+    size_t done = 0;
+    while (done < count) {
+        int ret = memfault_hid_read_reports(device, reports, count - done, READ_TIMEOUT_MS);
+        result->calls++;
+        if (ret < 1) {
+            return -EIO;
+        }
+        for (int i = 0; i < ret; i++) {
+            if (reports[i].buffer[0] != STREAM_REPORT_ID ||
+                reports[i].buffer[1] != (*expected)++ % 32) {
+                return -EIO;
+            }
+        }
+        done += (size_t)ret;
+    }
+    return 0;
+}
+
+static int run(int uhid_fd, memfault_hid_device_t *device, memfault_hid_raw_report_t *reports,
+               read_mode_t mode, size_t batch, size_t total, bench_result_t *result) {
+    uint8_t sequence = 0;
+    uint8_t expected = 0;
+
+    memset(result, 0, sizeof(*result));
+    while (result->reports < total) {
+        /* Injection is synchronous: the reports are queued when write() returns */
+        int ret = uhid_inject(uhid_fd, batch, &sequence);
+        if (ret < 0) {
+            return ret;
+        }
+
+        uint64_t wall = clock_ns(CLOCK_MONOTONIC);
+        uint64_t cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        ret = (mode == MODE_SINGLE) ? drain_single(device, batch, &expected, result)
+                                    : drain_batch(device, reports, batch, &expected, result);
+        result->cpu_ns += clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+        result->wall_ns += clock_ns(CLOCK_MONOTONIC) - wall;
+        if (ret < 0) {
+            return ret;
+        }
+        result->reports += batch;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t total = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000;
+    if (total == 0) {
+        fprintf(stderr, "Usage: %s [reports_per_run]\n", argv[0]);
+        return 2;
+    }
+
+    int uhid_fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+    if (uhid_fd < 0) {
+        fprintf(stderr, "/dev/uhid: %s (needs the uhid module and root)\n", strerror(errno));
+        return 1;
+    }
+
+    char uniq[32];
+    wchar_t serial[32];
+    snprintf(uniq, sizeof(uniq), "read-bench-%d", (int)getpid());
+    swprintf(serial, sizeof(serial) / sizeof(serial[0]), L"%s", uniq);
+
+    int ret = uhid_create(uhid_fd, uniq);
+    if (ret < 0) {
+        fprintf(stderr, "UHID_CREATE2: %s\n", strerror(-ret));
+        close(uhid_fd);
+        return 1;
+    }
+
+    memfault_hid_device_t *device = NULL;
+    memfault_hid_init();
+    if (open_bench_device(serial, &device) < 0) {
+        fprintf(stderr, "virtual device did not appear (is hidapi built for hidraw?)\n");
+        uhid_destroy(uhid_fd);
+        close(uhid_fd);
+        return 1;
+    }
+
+    /* Slots sized for the device's largest input report */
+    size_t slot_size = (size_t)memfault_hid_get_max_report_size(device,
+                                                                MEMFAULT_HID_REPORT_TYPE_INPUT) + 1;
+    uint8_t *storage = malloc(HIDRAW_QUEUE_LEN * slot_size);
+    memfault_hid_raw_report_t reports[HIDRAW_QUEUE_LEN];
+    if (storage == NULL) {
+        fprintf(stderr, "out of memory\n");
+        memfault_hid_close(device);
+        uhid_destroy(uhid_fd);
+        close(uhid_fd);
+        return 1;
+    }
+    for (size_t i = 0; i < HIDRAW_QUEUE_LEN; i++) {
+        reports[i].buffer = &storage[i * slot_size];
+        reports[i].size = slot_size;
+    }
+
+    static const size_t batches[] = {1, 4, 16, 64};
+    static const char *mode_names[] = {"read_report", "read_reports"};
+
+    printf("%zu reports of %d bytes per run\n\n", total, 1 + STREAM_REPORT_LEN);
+    printf("%5s  %-12s %10s %12s %12s\n", "batch", "mode", "calls", "wall ns/rpt", "cpu ns/rpt");
+
+    int status = 0;
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]) && status == 0; b++) {
+        for (read_mode_t mode = MODE_SINGLE; mode <= MODE_BATCH; mode++) {
+            bench_result_t r;
+            ret = run(uhid_fd, device, reports, mode, batches[b], total, &r);
+            if (ret < 0) {
+                fprintf(stderr, "%s, batch %zu: %s\n", mode_names[mode], batches[b],
+                        strerror(-ret));
+                status = 1;
+                break;
+            }
+            printf("%5zu  %-12s %10zu %12.0f %12.0f\n", batches[b], mode_names[mode], r.calls,
+                   (double)r.wall_ns / (double)r.reports, (double)r.cpu_ns / (double)r.reports);
+        }
+    }
+
+    free(storage);
+    memfault_hid_close(device);
+    memfault_hid_exit();
+    uhid_destroy(uhid_fd);
+    close(uhid_fd);
+    return status;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file retry_test.c
+ * @brief Uploader retry tests against tools/fault_server.py
+ *
+ * Exercises the retry scheduler and the spool against a server that fails
+ * requests on purpose. Run through tools/run_retry_test.sh, or by hand:
+ *
+ *   python3 tools/fault_server.py 18480 &
+ *   ./retry_test http://127.0.0.1:18480
+ */
+
+#include "memfault_hid/mds_spool.h"
+#include "memfault_hid/mds_upload.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define AUTH_HEADER "Memfault-Project-Key:test"
+#define POLL_INTERVAL_MS 20
+
+static const char *g_base_url;
+static int g_failures;
+
+#define CHECK(cond, ...)                                           \
+    do {                                                           \
+        if (!(cond)) {                                             \
+            fprintf(stderr, "  FAIL %s:%d: ", __func__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                          \
+            fprintf(stderr, "\n");                                 \
+            g_failures++;                                          \
+        }                                                          \
+    } while (0)
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(unsigned int ms) {
+    usleep(ms * 1000);
+}
+
+static const char *url(const char *path) {
+    static char buf[256];
+    snprintf(buf, sizeof(buf), "%s/%s", g_base_url, path);
+    return buf;
+}
+
+static int send_chunk(mds_uploader_t *uploader, const char *path, uint8_t tag) {
+    uint8_t chunk[32];
+    memset(chunk, tag, sizeof(chunk));
+    return mds_uploader_callback(url(path), AUTH_HEADER, chunk, sizeof(chunk), uploader);
+}
+
+static mds_upload_stats_t stats_of(mds_uploader_t *uploader) {
+    mds_upload_stats_t stats;
+    mds_uploader_get_stats(uploader, &stats);
+    return stats;
+}
+
+/* Poll until no retries are pending, returning the elapsed time */
+static uint64_t poll_until_idle(mds_uploader_t *uploader, uint64_t limit_ms) {
+    uint64_t start = now_ms();
+    while (stats_of(uploader).retries_pending > 0 && now_ms() - start < limit_ms) {
+        sleep_ms(POLL_INTERVAL_MS);
+        mds_uploader_poll(uploader);
+    }
+    return now_ms() - start;
+}
+
+static mds_uploader_t *create_uploader(uint32_t max_attempts, uint32_t base_delay_ms,
+                                       uint32_t max_delay_ms) {
+    mds_uploader_t *uploader = mds_uploader_create();
+    if (uploader == NULL) {
+        fprintf(stderr, "mds_uploader_create failed\n");
+        exit(1);
+    }
+
+    mds_retry_policy_t policy = {
+        .max_attempts = max_attempts,
+        .base_delay_ms = base_delay_ms,
+        .max_delay_ms = max_delay_ms,
+        .max_pending = 64,
+    };
+    mds_uploader_set_retry_policy(uploader, &policy);
+    return uploader;
+}
+
+/* Two 503s, then success: delivered after base and doubled backoff */
+static void test_backoff(void) {
+    mds_uploader_t *uploader = create_uploader(5, 200, 1000);
+
+    int ret = send_chunk(uploader, "f=2/dev=backoff", 1);
+    CHECK(ret == 0, "callback returned %d", ret);
+    CHECK(stats_of(uploader).retries_pending == 1, "chunk not queued for retry");
+
+    uint64_t elapsed = poll_until_idle(uploader, 5000);
+    mds_upload_stats_t stats = stats_of(uploader);
+    CHECK(stats.chunks_uploaded == 1, "uploaded %zu chunks", stats.chunks_uploaded);
+    CHECK(stats.retries == 2, "%zu retries", stats.retries);
+    /* Jitter draws from [d/2, d]: at least 100 + 200 ms */
+    CHECK(elapsed >= 300, "delivered after %" PRIu64 " ms, backoff too short", elapsed);
+    CHECK(elapsed < 1500, "delivered after %" PRIu64 " ms, backoff too long", elapsed);
+
+    mds_uploader_destroy(uploader);
+}
+
+/* Retry-After: 3600 is capped at max_delay_ms */
+static void test_retry_after_cap(void) {
+    mds_uploader_t *uploader = create_uploader(3, 100, 1000);
+
+    int ret = send_chunk(uploader, "f=1/ra=3600/dev=retry-after", 2);
+    CHECK(ret == 0, "callback returned %d", ret);
+
+    uint64_t elapsed = poll_until_idle(uploader, 5000);
+    mds_upload_stats_t stats = stats_of(uploader);
+    CHECK(stats.chunks_uploaded == 1, "uploaded %zu chunks", stats.chunks_uploaded);
+    CHECK(elapsed >= 900, "Retry-After ignored, retried after %" PRIu64 " ms", elapsed);
+    CHECK(elapsed < 2000, "Retry-After not capped, retried after %" PRIu64 " ms", elapsed);
+
+    mds_uploader_destroy(uploader);
+}
+
+/* A device with many failing chunks does not starve another device */
+static void test_fairness(void) {
+    mds_uploader_t *uploader = create_uploader(3, 100, 100);
+
+    for (uint8_t i = 0; i < 16; i++) {
+        send_chunk(uploader, "f=-1/dev=hog", (uint8_t)(0x10 + i));
+    }
+    int ret = send_chunk(uploader, "f=1/dev=fresh", 3);
+    CHECK(ret == 0, "callback returned %d", ret);
+
+    /* Every retry is due now; the first poll must serve both devices */
+    sleep_ms(300);
+    mds_uploader_poll(uploader);
+    mds_upload_stats_t stats = stats_of(uploader);
+    CHECK(stats.chunks_uploaded == 1, "fresh device starved by hog (%zu uploaded)",
+          stats.chunks_uploaded);
+
+    poll_until_idle(uploader, 5000);
+    stats = stats_of(uploader);
+    CHECK(stats.retries_exhausted == 16, "%zu retries exhausted", stats.retries_exhausted);
+
+    mds_uploader_destroy(uploader);
+}
+
+/* Fresh chunks are not held up by slow retries of another device */
+static void test_callback_not_blocked(void) {
+    mds_uploader_t *uploader = create_uploader(3, 100, 100);
+
+    for (uint8_t i = 0; i < 4; i++) {
+        send_chunk(uploader, "f=-1/d=300/dev=slow", (uint8_t)(0x20 + i));
+    }
+    sleep_ms(300);
+
+    uint64_t start = now_ms();
+    int ret = send_chunk(uploader, "dev=healthy", 4);
+    uint64_t elapsed = now_ms() - start;
+    CHECK(ret == 0, "callback returned %d", ret);
+    CHECK(elapsed < 250, "callback took %" PRIu64 " ms with retries due", elapsed);
+
+    mds_uploader_destroy(uploader);
+}
+
+/* Permanent failures are reported, not retried */
+static void test_permanent_failure(void) {
+    mds_uploader_t *uploader = create_uploader(5, 100, 1000);
+
+    int ret = send_chunk(uploader, "f=1/s=400/dev=permanent", 5);
+    mds_upload_stats_t stats = stats_of(uploader);
+    CHECK(ret < 0, "HTTP 400 acknowledged");
+    CHECK(stats.retries_pending == 0, "HTTP 400 queued for retry");
+
+    mds_uploader_destroy(uploader);
+}
+
+/* With a spool, a failed chunk is on disk before it is acknowledged */
+static void test_spool(void) {
+    char path[] = "/tmp/retry_test_spool_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        g_failures++;
+        return;
+    }
+    close(fd);
+    unlink(path);
+
+    mds_spool_t *spool = NULL;
+    int ret = mds_spool_open(path, 65536, &spool);
+    CHECK(ret == 0, "mds_spool_open returned %d", ret);
+    if (ret != 0) {
+        return;
+    }
+
+    mds_uploader_t *uploader = create_uploader(5, 200, 1000);
+    mds_uploader_set_spool(uploader, spool);
+
+    ret = send_chunk(uploader, "f=2/dev=spool", 6);
+    CHECK(ret == 0, "callback returned %d", ret);
+    CHECK(!mds_spool_is_empty(spool), "chunk acknowledged before it was spooled");
+    CHECK(stats_of(uploader).retries_pending == 0, "chunk held in memory as well");
+
+    uint64_t start = now_ms();
+    while (!mds_spool_is_empty(spool) && now_ms() - start < 5000) {
+        sleep_ms(POLL_INTERVAL_MS);
+        mds_uploader_poll(uploader);
+    }
+    mds_upload_stats_t stats = stats_of(uploader);
+    CHECK(mds_spool_is_empty(spool), "spool not drained");
+    CHECK(stats.chunks_drained == 1, "%zu chunks drained", stats.chunks_drained);
+
+    mds_uploader_destroy(uploader);
+    mds_spool_close(spool);
+    unlink(path);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s BASE_URL\n", argv[0]);
+        return 2;
+    }
+    g_base_url = argv[1];
+
+    static const struct {
+        const char *name;
+        void (*fn)(void);
+    } tests[] = {
+        {"backoff", test_backoff},
+        {"retry_after_cap", test_retry_after_cap},
+        {"fairness", test_fairness},
+        {"callback_not_blocked", test_callback_not_blocked},
+        {"permanent_failure", test_permanent_failure},
+        {"spool", test_spool},
+    };
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = g_failures;
+        tests[i].fn();
+        printf("%-22s %s\n", tests[i].name, g_failures == before ? "ok" : "FAILED");
+    }
+
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Build tools/retry_test.c against the uploader sources and run it against
+# tools/fault_server.py. Needs a C compiler, libcurl, zlib and python3.
+#
+# Usage: tools/run_retry_test.sh [PORT]
+
+set -eu
+
+cd "$(dirname "$0")/.."
+port=${1:-18480}
+build=$(mktemp -d)
+trap 'kill $server 2>/dev/null || true; rm -rf "$build"' EXIT INT TERM
+
+${CC:-cc} -std=gnu11 -O2 -Wall -Wextra -Iinclude \
+    -o "$build/retry_test" \
+    tools/retry_test.c src/mds_upload.c src/mds_spool.c \
+    -lcurl -lz -lpthread
+
+python3 tools/fault_server.py "$port" > "$build/server.log" &
+server=$!
+
+# Wait for the server to accept connections
+i=0
+until python3 -c "import socket; socket.create_connection(('127.0.0.1', $port)).close()" \
+        2>/dev/null; do
+    i=$((i + 1))
+    if [ "$i" -ge 50 ]; then
+        echo "fault_server.py did not start" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+if ! "$build/retry_test" "http://127.0.0.1:$port"; then
+    echo "--- server log ---" >&2
+    cat "$build/server.log" >&2
+    exit 1
+fi
@@ -178,13 +178,27 @@ int main(void)
 		return ret;
 	}
 
-	/* Initialize and enable USB device */
-	sample_usbd = sample_usbd_init_device(NULL);
+	/* Set up USB device descriptors */
+	sample_usbd = sample_usbd_setup_device(NULL);
 	if (sample_usbd == NULL) {
-		LOG_ERR("Failed to initialize USB device");
+		LOG_ERR("Failed to set up USB device");
 		return -ENODEV;
 	}
 
+	/* bcdDevice follows the firmware version; gateways key cached config on it */
+	ret = usbd_device_set_bcd_device(sample_usbd, mds_hid_get_bcd_device());
+	if (ret != 0) {
+		LOG_ERR("Failed to set bcdDevice, %d", ret);
+		return ret;
+	}
+
+	/* Initialize and enable USB device */
+	ret = usbd_init(sample_usbd);
+	if (ret != 0) {
+		LOG_ERR("Failed to initialize USB device, %d", ret);
+		return ret;
+	}
+
 	ret = usbd_enable(sample_usbd);
 	if (ret != 0) {
 		LOG_ERR("Failed to enable device support");
@@ -5,10 +5,13 @@
  */
 
 #include "mds_hid.h"
+#include "mds_lz4.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <memfault/config.h>
 #include <memfault/core/platform/device_info.h>
 #include <memfault/core/data_packetizer.h>
@@ -22,20 +25,75 @@ LOG_MODULE_REGISTER(mds_hid, LOG_LEVEL_INF);
 #define MDS_REPORT_ID_AUTHORIZATION         0x04
 #define MDS_REPORT_ID_STREAM_CONTROL        0x05
 #define MDS_REPORT_ID_STREAM_DATA           0x06
+#define MDS_REPORT_ID_STREAM_ACK            0x07
+#define MDS_REPORT_ID_DEVICE_CONFIG         0x08
 
 /* MDS Protocol Constants */
 #define MDS_MAX_DEVICE_ID_LEN               64
 #define MDS_MAX_URI_LEN                     128
 #define MDS_MAX_AUTH_LEN                    128
 #define MDS_MAX_CHUNK_DATA_LEN              61
+#define MDS_MAX_CHUNK_DATA_LEN_EXT          60
 #define MDS_SEQUENCE_MASK                   0x1F
+#define MDS_SEQUENCE_MASK_EXT               0xFFFF
+#define MDS_STREAM_REPORT_LEN               64
+#define MDS_STREAM_ACK_LEN                  5
+
+/* Device config report: type(1) + len(1) + value entries for every config field */
+#define MDS_CONFIG_TLV_SUPPORTED_FEATURES   0x01
+#define MDS_CONFIG_TLV_DEVICE_IDENTIFIER    0x02
+#define MDS_CONFIG_TLV_DATA_URI             0x03
+#define MDS_CONFIG_TLV_AUTHORIZATION        0x04
+#define MDS_CONFIG_TLV_HEADER_LEN           2
+#define MDS_DEVICE_CONFIG_LEN \
+	(4 * MDS_CONFIG_TLV_HEADER_LEN + 4 + MDS_MAX_DEVICE_ID_LEN + MDS_MAX_URI_LEN + \
+	 MDS_MAX_AUTH_LEN)
+
+/* Compressed mode: one packetizer chunk per frame, sent as frame slices */
+#define MDS_COMPRESS_FRAME_LEN              1024
+#define MDS_FRAME_HEADER_LEN                2     /* Raw length, little-endian */
+#define MDS_FRAME_CTRL_START                BIT(0)
+#define MDS_FRAME_CTRL_END                  BIT(1)
+#define MDS_FRAME_CTRL_STORED               BIT(2)
+
+/* Reliable mode: unacknowledged reports kept for selective retransmission */
+#define MDS_RELIABLE_WINDOW_SIZE            8
+#define MDS_RELIABLE_ACK_TIMEOUT_MS         500
+
+BUILD_ASSERT(IS_POWER_OF_TWO(MDS_RELIABLE_WINDOW_SIZE) &&
+	     MDS_RELIABLE_WINDOW_SIZE <= (MDS_SEQUENCE_MASK + 1) / 2,
+	     "Window must be a power of two no larger than half the sequence space");
 
 /* Stream control modes */
 #define MDS_STREAM_MODE_DISABLED            0x00
 #define MDS_STREAM_MODE_ENABLED             0x01
+#define MDS_STREAM_MODE_PRIORITY            0x02
+#define MDS_STREAM_MODE_FLAG_COMPRESSED     0x20
+#define MDS_STREAM_MODE_FLAG_EXTENDED_SEQ   0x40
+#define MDS_STREAM_MODE_FLAG_RELIABLE       0x80
+#define MDS_STREAM_MODE_FLAGS \
+	(MDS_STREAM_MODE_FLAG_COMPRESSED | MDS_STREAM_MODE_FLAG_EXTENDED_SEQ | \
+	 MDS_STREAM_MODE_FLAG_RELIABLE)
+
+/* Supported features bits */
+#define MDS_FEATURE_RELIABLE_STREAM         BIT(5)
+#define MDS_FEATURE_EXTENDED_SEQUENCE       BIT(6)
+#define MDS_FEATURE_COMPRESSED_STREAM       BIT(7)
+#define MDS_FEATURE_DEVICE_CONFIG_REPORT    BIT(8)
 
 /* Supported features bitmask - all features supported */
-static const uint32_t mds_supported_features = 0x0000001F;
+static const uint32_t mds_supported_features = 0x0000001F | MDS_FEATURE_RELIABLE_STREAM |
+					       MDS_FEATURE_EXTENDED_SEQUENCE |
+					       MDS_FEATURE_COMPRESSED_STREAM |
+					       MDS_FEATURE_DEVICE_CONFIG_REPORT;
+
+/* Drain order used in priority mode - one packetizer source mask per step */
+static const uint32_t mds_drain_priority[] = {
+	kMfltDataSourceMask_Coredump,
+	kMfltDataSourceMask_Event,
+	kMfltDataSourceMask_Log,
+	kMfltDataSourceMask_Cdr,
+};
 
 /* HID Report Descriptor for MDS Protocol */
 static const uint8_t hid_report_desc[] = {
@@ -94,12 +152,30 @@ static const uint8_t hid_report_desc[] = {
 	/* Input Report: Stream Data (Report ID 0x06, 63 bytes after ID = 64 total) */
 	0x85, MDS_REPORT_ID_STREAM_DATA,
 	0x09, 0x07,
-	0x95, 0x3F,  /* Report Count (63) - seq(1) + len(1) + data(61) */
+	0x95, 0x3F,  /* Report Count (63) - seq(1) + len(1) + data(61), or seq(2) + len(1) + data(60) */
 	0x75, 0x08,  /* Report Size (8) */
 	0x15, 0x00,  /* Logical Minimum (0) */
 	0x26, 0xFF, 0x00,  /* Logical Maximum (255) */
 	0x81, 0x02,  /* Input (Data, Variable, Absolute) */
 
+	/* Output Report: Stream Ack (Report ID 0x07, 5 bytes) - seq(1) + received bitmap(4) */
+	0x85, MDS_REPORT_ID_STREAM_ACK,
+	0x09, 0x08,
+	0x95, MDS_STREAM_ACK_LEN,  /* Report Count (5) */
+	0x75, 0x08,  /* Report Size (8) */
+	0x15, 0x00,  /* Logical Minimum (0) */
+	0x26, 0xFF, 0x00,  /* Logical Maximum (255) */
+	0x91, 0x02,  /* Output (Data, Variable, Absolute) */
+
+	/* Feature Report: Device Config (Report ID 0x08, 332 bytes) - all of 0x01-0x04 as TLVs */
+	0x85, MDS_REPORT_ID_DEVICE_CONFIG,
+	0x09, 0x09,
+	0x96, MDS_DEVICE_CONFIG_LEN & 0xFF, MDS_DEVICE_CONFIG_LEN >> 8,  /* Report Count (332) */
+	0x75, 0x08,  /* Report Size (8) */
+	0x15, 0x00,  /* Logical Minimum (0) */
+	0x26, 0xFF, 0x00,  /* Logical Maximum (255) */
+	0xB1, 0x02,  /* Feature (Data, Variable, Absolute) */
+
 	/* End Collection */
 	0xC0,
 };
@@ -108,21 +184,68 @@ static const uint8_t hid_report_desc[] = {
 struct mds_state {
 	bool hid_ready;
 	bool streaming_enabled;
-	uint8_t chunk_number;
+	bool reliable;
+	bool extended_seq;
+	bool compressed;
+	uint8_t stream_mode;
+	uint32_t active_sources;
+	uint16_t chunk_number;
 };
 
 static struct mds_state mds = {
 	.hid_ready = false,
 	.streaming_enabled = false,
+	.reliable = false,
+	.extended_seq = false,
+	.compressed = false,
+	.stream_mode = MDS_STREAM_MODE_DISABLED,
+	.active_sources = kMfltDataSourceMask_All,
 	.chunk_number = 0,
 };
 
+/* Reliable mode retransmit window, slots indexed by sequence number */
+struct mds_tx_window {
+	uint8_t reports[MDS_RELIABLE_WINDOW_SIZE][MDS_STREAM_REPORT_LEN];
+	uint8_t base;      /* Oldest unacknowledged sequence number */
+	uint8_t count;     /* Number of reports awaiting acknowledgement */
+	uint32_t resend;   /* Bit i set: resend sequence (base + i) */
+	int64_t last_ack;  /* Uptime of the last window progress */
+};
+
+static struct mds_tx_window tx_window;
+static struct k_spinlock tx_window_lock;
+
+/* Compressed mode frame: raw length header followed by an LZ4 block, or the
+ * raw chunk itself if it does not compress
+ */
+struct mds_tx_frame {
+	uint8_t raw[MDS_COMPRESS_FRAME_LEN];
+	uint8_t data[MDS_FRAME_HEADER_LEN + MDS_COMPRESS_FRAME_LEN];
+	size_t len;
+	size_t offset;
+	bool stored;
+};
+
+static struct mds_tx_frame tx_frame;
+
 /* Memfault configuration strings */
 #define MDS_URI_BASE \
 	MEMFAULT_HTTP_APIS_DEFAULT_SCHEME "://" MEMFAULT_HTTP_CHUNKS_API_HOST "/api/v0/chunks/"
 
 #define MDS_AUTH_KEY "Memfault-Project-Key: " CONFIG_MEMFAULT_NCS_PROJECT_KEY
 
+static void mds_tx_window_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&tx_window_lock);
+
+	tx_window.base = mds.chunk_number & MDS_SEQUENCE_MASK;
+	tx_window.count = 0;
+	tx_window.resend = 0;
+	tx_window.last_ack = k_uptime_get();
+
+	k_spin_unlock(&tx_window_lock, key);
+}
+
 static void mds_iface_ready(const struct device *dev, const bool ready)
 {
 	LOG_INF("HID device %s interface is %s",
@@ -132,11 +255,52 @@ static void mds_iface_ready(const struct device *dev, const bool ready)
 	/* Reset streaming state on USB disconnect - gateway must re-enable */
 	if (!ready) {
 		mds.streaming_enabled = false;
+		mds.reliable = false;
+		mds.extended_seq = false;
+		mds.compressed = false;
+		mds.stream_mode = MDS_STREAM_MODE_DISABLED;
 		mds.chunk_number = 0;
+		mds_tx_window_reset();
 		LOG_INF("Streaming state reset");
 	}
 }
 
+/* Data URI is the chunks API base followed by the device serial */
+static int mds_build_data_uri(char *uri, size_t size)
+{
+	sMemfaultDeviceInfo info;
+	memfault_platform_get_device_info(&info);
+
+	size_t uri_base_len = strlen(MDS_URI_BASE);
+	size_t uri_sn_len = strlen(info.device_serial);
+	size_t uri_len = uri_base_len + uri_sn_len;
+
+	if (uri_len > size) {
+		LOG_ERR("URI too long");
+		return -EINVAL;
+	}
+
+	memcpy(uri, MDS_URI_BASE, uri_base_len);
+	memcpy(&uri[uri_base_len], info.device_serial, uri_sn_len);
+	return uri_len;
+}
+
+/* Append a type-length-value entry to the device config report */
+static int mds_put_config_tlv(uint8_t *buf, size_t len, size_t *pos, uint8_t type,
+			      const void *value, size_t value_len)
+{
+	if (value_len > UINT8_MAX ||
+	    len - *pos < MDS_CONFIG_TLV_HEADER_LEN + value_len) {
+		return -EINVAL;
+	}
+
+	buf[(*pos)++] = type;
+	buf[(*pos)++] = value_len;
+	memcpy(&buf[*pos], value, value_len);
+	*pos += value_len;
+	return 0;
+}
+
 static int mds_get_report(const struct device *dev,
 			 const uint8_t type, const uint8_t id, const uint16_t len,
 			 uint8_t *const buf)
@@ -175,23 +339,14 @@ static int mds_get_report(const struct device *dev,
 	}
 
 	case MDS_REPORT_ID_DATA_URI: {
-		sMemfaultDeviceInfo info;
-		memfault_platform_get_device_info(&info);
-
 		char uri[MDS_MAX_URI_LEN];
-		size_t uri_base_len = strlen(MDS_URI_BASE);
-		size_t uri_sn_len = strlen(info.device_serial);
-		size_t uri_len = uri_base_len + uri_sn_len;
+		int uri_len = mds_build_data_uri(uri, sizeof(uri));
 
-		if (uri_len > sizeof(uri)) {
-			LOG_ERR("URI too long");
-			return -EINVAL;
+		if (uri_len < 0) {
+			return uri_len;
 		}
 
-		memcpy(uri, MDS_URI_BASE, uri_base_len);
-		memcpy(&uri[uri_base_len], info.device_serial, uri_sn_len);
-
-		size_t copy_len = (uri_len < (len - 1)) ? uri_len : (len - 1);
+		size_t copy_len = ((size_t)uri_len < (len - 1)) ? (size_t)uri_len : (len - 1);
 		memcpy(&buf[1], uri, copy_len);  /* Data starts at buf[1] */
 		return copy_len + 1;  /* payload + 1 for Report ID */
 	}
@@ -204,12 +359,100 @@ static int mds_get_report(const struct device *dev,
 		return copy_len + 1;  /* payload + 1 for Report ID */
 	}
 
+	case MDS_REPORT_ID_DEVICE_CONFIG: {
+		/* Reports 0x01-0x04 in one transfer; entries are never truncated */
+		sMemfaultDeviceInfo info;
+		memfault_platform_get_device_info(&info);
+
+		uint8_t features[4];
+		char uri[MDS_MAX_URI_LEN];
+		int uri_len = mds_build_data_uri(uri, sizeof(uri));
+
+		if (uri_len < 0) {
+			return uri_len;
+		}
+
+		sys_put_le32(mds_supported_features, features);
+
+		const struct {
+			uint8_t type;
+			const void *value;
+			size_t len;
+		} entries[] = {
+			{ MDS_CONFIG_TLV_SUPPORTED_FEATURES, features, sizeof(features) },
+			{ MDS_CONFIG_TLV_DEVICE_IDENTIFIER, info.device_serial,
+			  MIN(strlen(info.device_serial), MDS_MAX_DEVICE_ID_LEN) },
+			{ MDS_CONFIG_TLV_DATA_URI, uri, uri_len },
+			{ MDS_CONFIG_TLV_AUTHORIZATION, MDS_AUTH_KEY,
+			  MIN(strlen(MDS_AUTH_KEY), MDS_MAX_AUTH_LEN) },
+		};
+		size_t pos = 1;  /* Data starts at buf[1] */
+
+		for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+			int err = mds_put_config_tlv(buf, len, &pos, entries[i].type,
+						     entries[i].value, entries[i].len);
+			if (err) {
+				LOG_ERR("Device config does not fit %u bytes", len);
+				return err;
+			}
+		}
+
+		return pos;  /* TLV payload + 1 for Report ID */
+	}
+
 	default:
 		LOG_WRN("Unknown report ID %u", id);
 		return -ENOTSUP;
 	}
 }
 
+static int mds_handle_stream_ack(const uint8_t *buf, uint16_t len)
+{
+	if (len < 1 + MDS_STREAM_ACK_LEN) {
+		return -EINVAL;
+	}
+
+	/* buf[1]: highest contiguous sequence received,
+	 * buf[2..5]: bit i set if sequence (ack + 1 + i) was also received
+	 */
+	uint8_t ack = buf[1] & MDS_SEQUENCE_MASK;
+	uint32_t received = sys_get_le32(&buf[2]) & BIT_MASK(MDS_RELIABLE_WINDOW_SIZE);
+
+	k_spinlock_key_t key = k_spin_lock(&tx_window_lock);
+
+	uint8_t acked = (ack - tx_window.base + 1) & MDS_SEQUENCE_MASK;
+
+	if (acked > tx_window.count) {
+		/* Stale or out-of-window acknowledgement */
+		k_spin_unlock(&tx_window_lock, key);
+		LOG_DBG("Ignoring ack %u (base %u, count %u)", ack, tx_window.base,
+			tx_window.count);
+		return 0;
+	}
+
+	if (acked > 0) {
+		tx_window.base = (tx_window.base + acked) & MDS_SEQUENCE_MASK;
+		tx_window.count -= acked;
+		tx_window.resend >>= acked;
+		tx_window.last_ack = k_uptime_get();
+	}
+
+	/* Only gaps below the newest report the host has seen are losses,
+	 * anything above it may still be in flight
+	 */
+	uint32_t missing = ~received & BIT_MASK(find_msb_set(received));
+
+	tx_window.resend |= missing & BIT_MASK(tx_window.count);
+
+	k_spin_unlock(&tx_window_lock, key);
+
+	if (missing) {
+		LOG_DBG("Host ack %u, resending mask 0x%02x", ack, missing);
+	}
+
+	return 0;
+}
+
 static int mds_set_report(const struct device *dev,
 			 const uint8_t type, const uint8_t id, const uint16_t len,
 			 const uint8_t *const buf)
@@ -225,17 +468,42 @@ static int mds_set_report(const struct device *dev,
 			}
 
 			/* buf[0] contains the Report ID, actual data starts at buf[1] */
-			uint8_t mode = buf[1];
-			LOG_INF("Stream control: %s",
-				mode == MDS_STREAM_MODE_ENABLED ? "ENABLED" : "DISABLED");
-
-			if (mode == MDS_STREAM_MODE_ENABLED) {
+			uint8_t mode = buf[1] & ~MDS_STREAM_MODE_FLAGS;
+			uint8_t flags = buf[1] & MDS_STREAM_MODE_FLAGS;
+			LOG_INF("Stream control: %s%s%s%s",
+				mode == MDS_STREAM_MODE_PRIORITY ? "PRIORITY" :
+				mode == MDS_STREAM_MODE_ENABLED ? "ENABLED" : "DISABLED",
+				(flags & MDS_STREAM_MODE_FLAG_RELIABLE) ? " (reliable)" : "",
+				(flags & MDS_STREAM_MODE_FLAG_EXTENDED_SEQ) ? " (16-bit seq)" : "",
+				(flags & MDS_STREAM_MODE_FLAG_COMPRESSED) ? " (compressed)" : "");
+
+			if (mode == MDS_STREAM_MODE_ENABLED || mode == MDS_STREAM_MODE_PRIORITY) {
+				/* Source masks are applied from the sending thread */
+				mds.stream_mode = mode;
+				if (flags) {
+					/* Host expects a reliable/extended stream to start at 0 */
+					mds.chunk_number = 0;
+					mds_tx_window_reset();
+				}
+				/* Host drops a partial frame, start the next one afresh */
+				tx_frame.len = 0;
+				tx_frame.offset = 0;
+				mds.compressed = (flags & MDS_STREAM_MODE_FLAG_COMPRESSED) != 0;
+				mds.reliable = (flags & MDS_STREAM_MODE_FLAG_RELIABLE) != 0;
+				/* Compressed streams need the extended header's length byte */
+				mds.extended_seq = (flags & (MDS_STREAM_MODE_FLAG_EXTENDED_SEQ |
+							     MDS_STREAM_MODE_FLAG_COMPRESSED)) != 0;
 				mds.streaming_enabled = true;
 				/* Small delay to let gateway set up receive loop */
 				k_msleep(50);
 			} else if (mode == MDS_STREAM_MODE_DISABLED) {
 				mds.streaming_enabled = false;
+				mds.reliable = false;
+				mds.extended_seq = false;
+				mds.compressed = false;
+				mds.stream_mode = mode;
 				mds.chunk_number = 0;
+				mds_tx_window_reset();
 			} else {
 				LOG_WRN("Invalid stream mode %u", mode);
 				return -EINVAL;
@@ -255,9 +523,14 @@ static int mds_set_report(const struct device *dev,
 		return -ENOTSUP;
 	}
 
-	/* Handle Output Reports (none currently defined for MDS) */
-	LOG_WRN("Unknown output report ID %u", id);
-	return -ENOTSUP;
+	switch (id) {
+	case MDS_REPORT_ID_STREAM_ACK:
+		return mds_handle_stream_ack(buf, len);
+
+	default:
+		LOG_WRN("Unknown output report ID %u", id);
+		return -ENOTSUP;
+	}
 }
 
 static struct hid_device_ops mds_ops = {
@@ -282,15 +555,241 @@ bool mds_hid_is_streaming(void)
 	return mds.streaming_enabled;
 }
 
+uint16_t mds_hid_get_bcd_device(void)
+{
+	sMemfaultDeviceInfo info;
+	const char *p;
+	unsigned long part[3];
+	char *end;
+	bool bcd = true;
+
+	memfault_platform_get_device_info(&info);
+	p = info.software_version;
+
+	/* "MAJOR.MINOR.PATCH" with MAJOR <= 99 and single-digit MINOR and PATCH */
+	for (size_t i = 0; i < ARRAY_SIZE(part) && bcd; i++) {
+		part[i] = strtoul(p, &end, 10);
+		bcd = end != p && part[i] <= (i == 0 ? 99 : 9) &&
+		      *end == (i < ARRAY_SIZE(part) - 1 ? '.' : '\0');
+		p = end + 1;
+	}
+
+	if (bcd) {
+		return ((part[0] / 10) << 12) | ((part[0] % 10) << 8) | (part[1] << 4) | part[2];
+	}
+
+	/* Any other version string: FNV-1a folded to 16 bits, which still
+	 * changes from one firmware version to the next
+	 */
+	uint32_t hash = 2166136261U;
+
+	for (p = info.software_version; *p != '\0'; p++) {
+		hash = (hash ^ (uint8_t)*p) * 16777619U;
+	}
+	return (uint16_t)(hash ^ (hash >> 16));
+}
+
+static void mds_set_active_sources(uint32_t mask)
+{
+	if (mds.active_sources == mask) {
+		return;
+	}
+
+	/* Note: the packetizer aborts any in-progress message on a mask change */
+	memfault_packetizer_set_active_sources(mask);
+	mds.active_sources = mask;
+}
+
+static void mds_select_sources(void)
+{
+	if (mds.stream_mode != MDS_STREAM_MODE_PRIORITY) {
+		mds_set_active_sources(kMfltDataSourceMask_All);
+		return;
+	}
+
+	/* Only re-prioritize between messages so a partially sent one is not restarted */
+	const sPacketizerConfig cfg = {
+		.enable_multi_packet_chunk = false,
+	};
+	sPacketizerMetadata metadata;
+
+	if (memfault_packetizer_begin(&cfg, &metadata) && metadata.send_in_progress) {
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(mds_drain_priority); i++) {
+		mds_set_active_sources(mds_drain_priority[i]);
+		if (memfault_packetizer_data_available()) {
+			LOG_DBG("Draining source mask 0x%02x", mds_drain_priority[i]);
+			return;
+		}
+	}
+}
+
+static int mds_submit_report(const struct device *hid_dev, uint8_t *report)
+{
+	/* Submit 64 bytes with retry on buffer full */
+	int ret;
+	int retries = 10;
+	do {
+		ret = hid_device_submit_report(hid_dev, MDS_STREAM_REPORT_LEN, report);
+		if (ret == -EBUSY || ret == -EAGAIN) {
+			LOG_WRN("HID busy, retrying...");
+			k_msleep(10);
+			retries--;
+		} else {
+			break;
+		}
+	} while (retries > 0);
+
+	return ret;
+}
+
+/* Send one report pending retransmission, 0 if nothing is pending */
+static int mds_send_retransmit(const struct device *hid_dev)
+{
+	uint8_t report[MDS_STREAM_REPORT_LEN];
+	k_spinlock_key_t key = k_spin_lock(&tx_window_lock);
+
+	/* No acknowledgement progress: assume the tail was lost and resend it all */
+	if (tx_window.resend == 0 && tx_window.count > 0 &&
+	    k_uptime_get() - tx_window.last_ack > MDS_RELIABLE_ACK_TIMEOUT_MS) {
+		tx_window.resend = BIT_MASK(tx_window.count);
+		tx_window.last_ack = k_uptime_get();
+	}
+
+	if (tx_window.resend == 0) {
+		k_spin_unlock(&tx_window_lock, key);
+		return 0;
+	}
+
+	uint8_t offset = find_lsb_set(tx_window.resend) - 1;
+	uint8_t seq = (tx_window.base + offset) & MDS_SEQUENCE_MASK;
+
+	tx_window.resend &= ~BIT(offset);
+	memcpy(report, tx_window.reports[seq & (MDS_RELIABLE_WINDOW_SIZE - 1)], sizeof(report));
+
+	k_spin_unlock(&tx_window_lock, key);
+
+	int ret = mds_submit_report(hid_dev, report);
+	if (ret) {
+		/* Left to the ack timeout to schedule again */
+		LOG_ERR("Failed to resend chunk #%u, err %d", seq, ret);
+		return ret;
+	}
+
+	LOG_DBG("Resent chunk #%u", seq);
+	return mds.extended_seq ? report[3] : report[2];
+}
+
+static bool mds_tx_window_full(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&tx_window_lock);
+	bool full = tx_window.count >= MDS_RELIABLE_WINDOW_SIZE;
+
+	k_spin_unlock(&tx_window_lock, key);
+	return full;
+}
+
+static void mds_tx_window_push(const uint8_t *report)
+{
+	k_spinlock_key_t key = k_spin_lock(&tx_window_lock);
+
+	if (tx_window.count == 0) {
+		tx_window.last_ack = k_uptime_get();
+	}
+	memcpy(tx_window.reports[report[1] & (MDS_RELIABLE_WINDOW_SIZE - 1)], report,
+	       MDS_STREAM_REPORT_LEN);
+	tx_window.count++;
+
+	k_spin_unlock(&tx_window_lock, key);
+}
+
+static bool mds_tx_frame_load(void)
+{
+	size_t raw_len = sizeof(tx_frame.raw);
+
+	mds_select_sources();
+
+	if (!memfault_packetizer_get_chunk(tx_frame.raw, &raw_len)) {
+		return false;
+	}
+
+	sys_put_le16(raw_len, tx_frame.data);
+
+	/* Only keep the compressed block if it is actually smaller */
+	int ret = mds_lz4_compress(tx_frame.raw, raw_len,
+				   &tx_frame.data[MDS_FRAME_HEADER_LEN], raw_len - 1);
+	if (ret > 0) {
+		tx_frame.len = MDS_FRAME_HEADER_LEN + ret;
+		tx_frame.stored = false;
+	} else {
+		memcpy(&tx_frame.data[MDS_FRAME_HEADER_LEN], tx_frame.raw, raw_len);
+		tx_frame.len = MDS_FRAME_HEADER_LEN + raw_len;
+		tx_frame.stored = true;
+	}
+	tx_frame.offset = 0;
+
+	LOG_DBG("Frame %zu -> %zu bytes%s", raw_len, tx_frame.len - MDS_FRAME_HEADER_LEN,
+		tx_frame.stored ? " (stored)" : "");
+	return true;
+}
+
+/* Fill a report payload with a frame control byte and the next frame slice */
+static bool mds_tx_frame_next(uint8_t *payload, size_t max_len, size_t *len)
+{
+	if (tx_frame.offset >= tx_frame.len && !mds_tx_frame_load()) {
+		return false;
+	}
+
+	size_t slice = MIN(max_len - 1, tx_frame.len - tx_frame.offset);
+
+	payload[0] = (tx_frame.offset == 0 ? MDS_FRAME_CTRL_START : 0) |
+		     (tx_frame.offset + slice == tx_frame.len ? MDS_FRAME_CTRL_END : 0) |
+		     (tx_frame.stored ? MDS_FRAME_CTRL_STORED : 0);
+	memcpy(&payload[1], &tx_frame.data[tx_frame.offset], slice);
+	tx_frame.offset += slice;
+
+	*len = slice + 1;
+	return true;
+}
+
 int mds_hid_send_chunk(const struct device *hid_dev)
 {
-	uint8_t report[64];  /* Report ID (1) + sequence (1) + length (1) + data (61) = 64 */
-	size_t chunk_max_size = MDS_MAX_CHUNK_DATA_LEN;  /* 61 */
+	uint8_t report[MDS_STREAM_REPORT_LEN];  /* Report ID (1) + sequence (1) + length (1) + data (61) = 64 */
+	/* Extended header: Report ID (1) + sequence (2) + length (1) + data (60) = 64 */
+	size_t chunk_max_size = mds.extended_seq ? MDS_MAX_CHUNK_DATA_LEN_EXT :
+						   MDS_MAX_CHUNK_DATA_LEN;  /* 60 or 61 */
+	size_t header_len = MDS_STREAM_REPORT_LEN - chunk_max_size;
 	size_t chunk_size = chunk_max_size;
 	bool data_available;
+	int ret;
 
-	/* Get chunk from Memfault packetizer - data starts at byte 3 */
-	data_available = memfault_packetizer_get_chunk(&report[3], &chunk_size);
+	if (mds.reliable) {
+		/* Retransmissions go ahead of new data */
+		ret = mds_send_retransmit(hid_dev);
+		if (ret != 0) {
+			return ret;
+		}
+
+		/* Hold new data until the host acknowledges the window */
+		if (mds_tx_window_full()) {
+			return 0;
+		}
+	}
+
+	if (mds.compressed) {
+		/* Payload is a slice of the current compressed frame */
+		data_available = mds_tx_frame_next(&report[header_len], chunk_max_size,
+						   &chunk_size);
+	} else {
+		/* Restrict the packetizer to the highest priority source with data */
+		mds_select_sources();
+
+		/* Get chunk from Memfault packetizer - data starts after the header */
+		data_available = memfault_packetizer_get_chunk(&report[header_len],
+							       &chunk_size);
+	}
 
 	if (!data_available) {
 		return 0;  /* No data available */
@@ -299,15 +798,20 @@ int mds_hid_send_chunk(const struct device *hid_dev)
 	/* Set Report ID in first byte */
 	report[0] = MDS_REPORT_ID_STREAM_DATA;  /* 0x06 */
 
-	/* Set sequence number in second byte (bits 0-4) */
-	report[1] = mds.chunk_number & MDS_SEQUENCE_MASK;
+	if (mds.extended_seq) {
+		/* Set 16-bit little-endian sequence number in bytes 1-2 */
+		sys_put_le16(mds.chunk_number, &report[1]);
+	} else {
+		/* Set sequence number in second byte (bits 0-4) */
+		report[1] = mds.chunk_number & MDS_SEQUENCE_MASK;
+	}
 
-	/* Set payload length in third byte */
-	report[2] = (uint8_t)chunk_size;
+	/* Set payload length in the last header byte */
+	report[header_len - 1] = (uint8_t)chunk_size;
 
 	/* Pad remaining bytes (gateway will ignore based on length byte) */
-	if (chunk_size < MDS_MAX_CHUNK_DATA_LEN) {
-		memset(&report[3 + chunk_size], 0, MDS_MAX_CHUNK_DATA_LEN - chunk_size);
+	if (chunk_size < chunk_max_size) {
+		memset(&report[header_len + chunk_size], 0, chunk_max_size - chunk_size);
 	}
 
 	/* Debug: Log the full report header and first 16 bytes of payload */
@@ -317,32 +821,33 @@ int mds_hid_send_chunk(const struct device *hid_dev)
 		report[3], report[4], report[5], report[6], report[7], report[8], report[9], report[10],
 		report[11], report[12], report[13], report[14], report[15], report[16], report[17], report[18]);
 
-	/* Submit 64 bytes with retry on buffer full */
-	int ret;
-	int retries = 10;
-	do {
-		ret = hid_device_submit_report(hid_dev, 64, report);
-		if (ret == -EBUSY || ret == -EAGAIN) {
-			LOG_WRN("HID busy, retrying...");
-			k_msleep(10);
-			retries--;
-		} else {
-			break;
-		}
-	} while (retries > 0);
+	/* In reliable mode the window owns the chunk from here on */
+	if (mds.reliable) {
+		mds_tx_window_push(report);
+	}
 
-	if (ret) {
+	ret = mds_submit_report(hid_dev, report);
+
+	if (ret && !mds.reliable) {
 		memfault_packetizer_abort();
+		/* The rest of the frame is useless to the host without this slice */
+		tx_frame.offset = tx_frame.len;
 		LOG_ERR("Failed to send chunk after retries, err %d", ret);
 		return ret;
 	}
 
-	LOG_DBG("Sent chunk #%d, size %zu bytes", mds.chunk_number, chunk_size);
+	if (ret) {
+		LOG_WRN("Failed to send chunk #%d, err %d, awaiting retransmit",
+			mds.chunk_number, ret);
+	} else {
+		LOG_DBG("Sent chunk #%d, size %zu bytes", mds.chunk_number, chunk_size);
+	}
 
-	/* Update chunk number (wraps at 31) */
-	mds.chunk_number = (mds.chunk_number + 1) & MDS_SEQUENCE_MASK;
+	/* Update chunk number (wraps at 31, or 65535 with extended sequence) */
+	mds.chunk_number = (mds.chunk_number + 1) &
+			   (mds.extended_seq ? MDS_SEQUENCE_MASK_EXT : MDS_SEQUENCE_MASK);
 
-	return chunk_size;
+	return ret ? ret : chunk_size;
 }
 
 const uint8_t *mds_hid_get_report_desc(size_t *size)
@@ -34,6 +34,18 @@ bool mds_hid_is_ready(void);
  */
 bool mds_hid_is_streaming(void);
 
+/**
+ * @brief Get the USB device release number (bcdDevice) for this firmware
+ *
+ * Derived from the Memfault software version, so that it changes with every
+ * firmware update: "MAJOR.MINOR.PATCH" is encoded as BCD 0xMMmp when it
+ * fits, any other version string as a 16-bit hash of it. The gateway's
+ * configuration cache is keyed on this value.
+ *
+ * @return bcdDevice value
+ */
+uint16_t mds_hid_get_bcd_device(void);
+
 /**
  * @brief Send a Memfault diagnostic data chunk
  *
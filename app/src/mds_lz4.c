@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "mds_lz4.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* LZ4 block format constants */
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5   /* Block must end with this many literals */
+#define LZ4_MF_LIMIT        12  /* Last match must start this far from the end */
+#define LZ4_MAX_OFFSET      65535
+#define LZ4_RUN_MASK        15
+
+/* 256 entry hash table: 512 bytes of RAM */
+#define LZ4_HASH_LOG        8
+
+static uint16_t hash_table[1 << LZ4_HASH_LOG];
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t hash32(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Write an LZ4 length continuation (bytes of 255 then remainder) */
+static int put_length(uint8_t *dst, size_t dst_cap, size_t *op, size_t len)
+{
+	while (len >= 255) {
+		if (*op >= dst_cap) {
+			return -ENOSPC;
+		}
+		dst[(*op)++] = 255;
+		len -= 255;
+	}
+
+	if (*op >= dst_cap) {
+		return -ENOSPC;
+	}
+	dst[(*op)++] = (uint8_t)len;
+	return 0;
+}
+
+/* Emit one sequence: literals, then an optional match (match_len 0 = last sequence) */
+static int put_sequence(uint8_t *dst, size_t dst_cap, size_t *op,
+			const uint8_t *literals, size_t lit_len,
+			uint16_t offset, size_t match_len)
+{
+	size_t token_pos = *op;
+	uint8_t token;
+
+	if (*op >= dst_cap) {
+		return -ENOSPC;
+	}
+	(*op)++;
+
+	token = (lit_len >= LZ4_RUN_MASK) ? (LZ4_RUN_MASK << 4) : (uint8_t)(lit_len << 4);
+	if (lit_len >= LZ4_RUN_MASK &&
+	    put_length(dst, dst_cap, op, lit_len - LZ4_RUN_MASK)) {
+		return -ENOSPC;
+	}
+
+	if (lit_len > dst_cap - *op) {
+		return -ENOSPC;
+	}
+	memcpy(&dst[*op], literals, lit_len);
+	*op += lit_len;
+
+	if (match_len > 0) {
+		size_t ml = match_len - LZ4_MIN_MATCH;
+
+		if (dst_cap - *op < 2) {
+			return -ENOSPC;
+		}
+		dst[(*op)++] = offset & 0xFF;
+		dst[(*op)++] = offset >> 8;
+
+		token |= (ml >= LZ4_RUN_MASK) ? LZ4_RUN_MASK : (uint8_t)ml;
+		if (ml >= LZ4_RUN_MASK &&
+		    put_length(dst, dst_cap, op, ml - LZ4_RUN_MASK)) {
+			return -ENOSPC;
+		}
+	}
+
+	dst[token_pos] = token;
+	return 0;
+}
+
+int mds_lz4_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_cap)
+{
+	size_t ip = 0;
+	size_t anchor = 0;
+	size_t op = 0;
+
+	if (src == NULL || dst == NULL || src_len > MDS_LZ4_MAX_INPUT_LEN) {
+		return -EINVAL;
+	}
+
+	memset(hash_table, 0, sizeof(hash_table));
+
+	/* Inputs shorter than the match limit are stored as literals only */
+	while (src_len >= LZ4_MF_LIMIT && ip + LZ4_MF_LIMIT <= src_len) {
+		uint32_t seq = read32(&src[ip]);
+		uint32_t h = hash32(seq);
+		size_t ref = hash_table[h];
+
+		hash_table[h] = (uint16_t)ip;
+
+		if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(&src[ref]) != seq) {
+			ip++;
+			continue;
+		}
+
+		/* Extend the match, leaving the mandatory trailing literals */
+		size_t match_len = LZ4_MIN_MATCH;
+
+		while (ip + match_len < src_len - LZ4_LAST_LITERALS &&
+		       src[ref + match_len] == src[ip + match_len]) {
+			match_len++;
+		}
+
+		if (put_sequence(dst, dst_cap, &op, &src[anchor], ip - anchor,
+				 (uint16_t)(ip - ref), match_len)) {
+			return -ENOSPC;
+		}
+
+		ip += match_len;
+		anchor = ip;
+	}
+
+	if (put_sequence(dst, dst_cap, &op, &src[anchor], src_len - anchor, 0, 0)) {
+		return -ENOSPC;
+	}
+
+	return (int)op;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef MDS_LZ4_H_
+#define MDS_LZ4_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Largest input accepted by mds_lz4_compress() (positions are 16-bit) */
+#define MDS_LZ4_MAX_INPUT_LEN               UINT16_MAX
+
+/**
+ * @brief Compress a buffer into an LZ4 block
+ *
+ * Minimal single-pass LZ4 block encoder with a small hash table, intended
+ * for packetizer chunks of a few hundred bytes to a few kilobytes. The
+ * output is a standard LZ4 block (no frame header) and can be decoded with
+ * any LZ4 block decoder.
+ *
+ * @param src Data to compress
+ * @param src_len Length of data, at most MDS_LZ4_MAX_INPUT_LEN
+ * @param dst Buffer to receive the compressed block
+ * @param dst_cap Size of dst
+ * @return Compressed length on success, -ENOSPC if the block does not fit
+ *         in dst_cap, negative errno on other errors
+ */
+int mds_lz4_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_cap);
+
+#endif /* MDS_LZ4_H_ */